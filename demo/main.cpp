@@ -94,6 +94,8 @@ private:
         ObjLoader sphereLoader;
         sphereLoader.loadModel(m_cwd / "media/scenes/sphere.obj");
         m_app.getVulkan().loadModel(sphereLoader);
+        // 球体顶点由计算着色器做动画，BLAS需要refit
+        m_app.getVulkan().m_objModel.back().usage = BlasUsage::eDeformable;
 
         m_app.createBVH();
     }
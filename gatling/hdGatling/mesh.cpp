@@ -343,6 +343,20 @@ namespace
     _tokens->UV1
   };
 
+  // GfMatrix4f是行主序，逐元素拷贝到列主序的glm::mat4
+  glm::mat4 _ToGlm(const GfMatrix4f& m)
+  {
+    glm::mat4 result;
+    for (int i = 0; i < 4; ++i)
+    {
+      for (int j = 0; j < 4; ++j)
+      {
+        result[i][j] = m[i][j];
+      }
+    }
+    return result;
+  }
+
   bool _IsPrimvarEligibleForVertexData(const TfToken& name, const TfToken& role)
   {
     if (name == HdTokens->normals ||
@@ -374,6 +388,22 @@ HdGatlingMesh::HdGatlingMesh(const SdfPath& id,
 
 void HdGatlingMesh::Finalize(HdRenderParam* renderParam)
 {
+  TF_UNUSED(renderParam);
+
+  // 释放对共享几何的引用，gpu端实例在下一帧被隐藏
+  std::lock_guard guard(_scene.mutex);
+  if (_mesh_id == -1)
+  {
+    return;
+  }
+  _MeshPrim& prim = _scene.v_mesh[_mesh_id];
+  if (prim.geom_id != -1)
+  {
+    _scene.ReleaseGeometry(prim.geom_id);
+    prim.geom_id = -1;
+  }
+  prim.removed = true;
+  prim._changed = true;
 }
 
 void HdGatlingMesh::Sync(HdSceneDelegate* sceneDelegate,
@@ -408,8 +438,7 @@ void HdGatlingMesh::Sync(HdSceneDelegate* sceneDelegate,
     return;
   }
 
-  glm::mat4 trans_instance = glm::mat4(1);
-  glm::mat4 trans_single = glm::mat4(1);
+  bool updateTransforms = false;
 
   if ((*dirtyBits & HdChangeTracker::DirtyInstancer) || (*dirtyBits & HdChangeTracker::DirtyInstanceIndex))
   {
@@ -434,31 +463,41 @@ void HdGatlingMesh::Sync(HdSceneDelegate* sceneDelegate,
       HdInstancer* boxedInstancer = renderIndex.GetInstancer(instancerId);
       HdGatlingInstancer* instancer = static_cast<HdGatlingInstancer*>(boxedInstancer);
 
+      // 嵌套的instancer在 ComputeFlattenedTransforms 中逐级展开
       transforms = instancer->ComputeFlattenedTransforms(id);
       instancerPrimvars = instancer->ComputeFlattenedPrimvars(id);
       instanceIds = sceneDelegate->GetInstanceIndices(instancerId, id);
     }
 
+    // 每个变换对应一个TLAS实例，共享原型的BLAS
     auto transformsSize = uint32_t(transforms.size());
-    auto transformsData = (const float(*)[4][4]) transforms[0].data();
-    assert(transformsSize == 1); //only support size==1 
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            trans_instance[i][j] = transformsData[0][i][j]; // Direct copy since GfMatrix4f is row-major
-        }
+    _instancerTransforms.resize(transformsSize);
+    for (uint32_t k = 0; k < transformsSize; k++)
+    {
+      _instancerTransforms[k] = _ToGlm(transforms[k]);
     }
+    updateTransforms = true;
   }
 
   if (*dirtyBits & HdChangeTracker::DirtyTransform)
   {
-    auto transform = GfMatrix4f(sceneDelegate->GetTransform(id));
-    for (int i = 0; i < 4; ++i) {
-        for (int j = 0; j < 4; ++j) {
-            trans_single[i][j] = transform[i][j]; // Direct copy since GfMatrix4f is row-major
-        }
+    _protoTransform = _ToGlm(GfMatrix4f(sceneDelegate->GetTransform(id)));
+    updateTransforms = true;
+  }
+
+  if (updateTransforms)
+  {
+    // 其他mesh并行Sync时可能扩容v_mesh
+    std::lock_guard guard(_scene.mutex);
+    _MeshPrim& prim = _scene.v_mesh[_mesh_id];
+    prim._transforms.resize(_instancerTransforms.size());
+    for (size_t k = 0; k < _instancerTransforms.size(); k++)
+    {
+      // Gf是行向量约定，直接拷贝到glm后相当于转置，先应用prim自身变换，再应用实例变换
+      prim._transforms[k] = _instancerTransforms[k] * _protoTransform;
     }
+    prim._changed = true;
   }
-  _scene.v_mesh[_mesh_id]._transform = trans_single*trans_instance;
 
   *dirtyBits = HdChangeTracker::Clean;
 }
@@ -893,17 +932,22 @@ void HdGatlingMesh::_CreateGiMeshes(HdSceneDelegate* sceneDelegate)
     .points = points,
     .normals = normals,
     .texCoords = texCoords,
-    .materialIds = materialIds,     // 新增：每个面的材质 ID
-    ._changed = true
+    .materialIds = materialIds     // 新增：每个面的材质 ID
   };
+  // 哈希在锁外计算，大mesh并行Sync时不互相阻塞
+  uint64_t hash = HashVertexStreams(s);
 
   {
       std::lock_guard guard(_scene.mutex);
       if(_mesh_id == -1){
+        _MeshPrim prim;
+        prim.geom_id = _scene.AcquireGeometry(s, hash);
         _mesh_id = _scene.v_mesh.size();
-        _scene.v_mesh.emplace_back(s);
+        _scene.v_mesh.emplace_back(prim);
       } else {
-        _scene.v_mesh[_mesh_id] = s;
+        _MeshPrim& prim = _scene.v_mesh[_mesh_id];
+        prim.geom_id = _scene.UpdateGeometry(prim.geom_id, s, hash);
+        prim._changed = true;
       }
   }
 }
@@ -80,6 +80,9 @@ private:
 private:
   HdGatlingScene& _scene;
   int             _mesh_id = -1;
+  // 最近一次同步的变换，只有对应的dirty位被设置时才更新
+  glm::mat4              _protoTransform{1.0f};
+  std::vector<glm::mat4> _instancerTransforms{glm::mat4(1.0f)};
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
@@ -89,6 +89,7 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
   const auto& hdAovBindings = renderPassState->GetAovBindings();
 #if USE_RAY_TRACE
   app_init(hdAovBindings[0]);
+  app_applySettings();
   app_updateCamera(*hdcamera);
 #if USE_BASE_RENDER
   app_anim_base();
@@ -96,6 +97,8 @@ void HdGatlingRenderPass::_Execute(const HdRenderPassStateSharedPtr& renderPassS
   app_anim_real();
 #endif
   _renderApp.render();
+  // 摄像机、场景和光源不变时逐帧累积，达到样本数或方差阈值后收敛，之后render()不再发射光线
+  _isConverged = _renderApp.getVulkan().isConverged();
 #endif
 
   for (const HdRenderPassAovBinding& binding : hdAovBindings)
@@ -134,17 +137,30 @@ void HdGatlingRenderPass::app_init(const HdRenderPassAovBinding& binding)
   _renderApp.loadScene();
 #else
   bool init_texture = true;
+  HelloVulkan& vk = _renderApp.getVulkan();
   for(auto& cur_mesh:_scene.v_mesh){
-      ModelLoader loader;
-      ConvertVmeshToLoader(cur_mesh,loader);
-      add_default_material(loader);
-      loader.m_textures.clear();
-      if(init_texture) {
-        loader.m_textures.push_back("aMedKitm_albedo.jpg");
-        loader.m_textures.push_back("PatrickStar.jpg");
-        init_texture = false;
+      if(cur_mesh.removed){
+        continue;
+      }
+      _SharedGeometry& geom = _scene.v_geom[cur_mesh.geom_id];
+      cur_mesh._changed = false;
+      // 同一份几何只上传一次，其余mesh和点实例化的每个变换都是共享BLAS的实例
+      if(geom.model_id == -1){
+        ModelLoader loader;
+        ConvertVmeshToLoader(geom.streams,loader);
+        add_default_material(loader);
+        loader.m_textures.clear();
+        if(init_texture) {
+          loader.m_textures.push_back("aMedKitm_albedo.jpg");
+          loader.m_textures.push_back("PatrickStar.jpg");
+          init_texture = false;
+        }
+        geom.model_id = static_cast<int>(vk.m_objModel.size());
+        geom.changed = false;
+        vk.loadModel(loader);
+        cur_mesh.instance_ids.push_back(static_cast<int>(vk.m_instances.size()) - 1);
       }
-      _renderApp.getVulkan().loadModel(loader);    
+      app_syncInstances(cur_mesh, geom.model_id);
     }
 #endif
     _renderApp.createBVH();
@@ -153,6 +169,32 @@ void HdGatlingRenderPass::app_init(const HdRenderPassAovBinding& binding)
   }
 }
 
+// 设置缺失或类型不可转换时使用默认值
+template<typename T>
+static T GetSetting(const HdRenderSettingsMap& settings, const TfToken& key, T fallback)
+{
+  auto it = settings.find(key);
+  if (it == settings.end() || !it->second.CanCast<T>()) {
+    return fallback;
+  }
+  return it->second.Cast<T>().template UncheckedGet<T>();
+}
+
+void HdGatlingRenderPass::app_applySettings()
+{
+  HelloVulkan& vk = _renderApp.getVulkan();
+  HelloVulkan::RenderSettings rs = vk.getRenderSettings();
+  rs.spp = static_cast<uint32_t>(std::max(GetSetting<int>(_settings, HdGatlingSettingsTokens->spp, 1), 1));
+  rs.maxBounces = static_cast<uint32_t>(std::max(GetSetting<int>(_settings, HdGatlingSettingsTokens->maxBounces, 2), 0));
+  rs.rrBounceOffset = static_cast<uint32_t>(std::max(GetSetting<int>(_settings, HdGatlingSettingsTokens->rrBounceOffset, 3), 0));
+  rs.rrInvMinTermProb = GetSetting<float>(_settings, HdGatlingSettingsTokens->rrInvMinTermProb, 0.95f);
+  rs.progressiveAccumulation = GetSetting<bool>(_settings, HdGatlingSettingsTokens->progressiveAccumulation, true);
+  rs.jitteredSampling = GetSetting<bool>(_settings, HdGatlingSettingsTokens->jitteredSampling, true);
+  rs.pathTracing = GetSetting<bool>(_settings, HdGatlingSettingsTokens->pathTracing, false);
+  // 只有设置改变时才重新累积；反射次数决定管线递归深度，每种深度的管线只创建一次（路径追踪变体的递归深度总是1）
+  vk.setRenderSettings(rs);
+}
+
 void HdGatlingRenderPass::app_updateCamera(const HdCamera& camera)
 {
     const GfMatrix4d& transform = camera.GetTransform();
@@ -207,12 +249,73 @@ void HdGatlingRenderPass::app_updateCamera(const HdCamera& camera)
 
 void HdGatlingRenderPass::app_anim_real()
 {
-  for(size_t i = 0; i < _scene.v_mesh.size(); ++i){
-    if(_scene.v_mesh[i]._changed){
-      _scene.v_mesh[i]._changed = false;
-      ConvertVmeshToLoader(_scene.v_mesh[i],_renderApp.getVulkan().m_Loader[i]);
-      _renderApp.getVulkan().updateBlas(i);
-      _renderApp.getVulkan().updateTlas(i,_scene.v_mesh[i]._transform);
+  HelloVulkan& vk = _renderApp.getVulkan();
+  for(auto& cur_mesh:_scene.v_mesh){
+    if(!cur_mesh._changed){
+      continue;
+    }
+    cur_mesh._changed = false;
+
+    // 已删除的mesh：隐藏实例（保持实例序号不变）
+    if(cur_mesh.removed){
+      for(int inst : cur_mesh.instance_ids){
+        vk.setInstanceVisible(inst, false);
+      }
+      continue;
+    }
+
+    _SharedGeometry& geom = _scene.v_geom[cur_mesh.geom_id];
+    if(geom.model_id == -1){
+      // 初始化之后新到达的几何：追加到场景（bindless描述符，无需重建管线）
+      ModelLoader loader;
+      ConvertVmeshToLoader(geom.streams,loader);
+      add_default_material(loader);
+      loader.m_textures.clear();
+      geom.changed = false;
+      geom.model_id = vk.addModel(loader);
+      // addModel附带一个实例：新mesh用它作为第一个实例；已有实例的mesh（共享几何后形变成新内容）改引用新模型，隐藏它
+      int extra = static_cast<int>(vk.m_instances.size()) - 1;
+      if(cur_mesh.instance_ids.empty()){
+        cur_mesh.instance_ids.push_back(extra);
+      } else {
+        vk.setInstanceVisible(extra, false);
+      }
+    } else if(geom.changed){
+      // 几何被原地更新（只有这一个mesh引用）：重新上传顶点并refit
+      geom.changed = false;
+      ConvertVmeshToLoader(geom.streams,vk.m_Loader[geom.model_id]);
+      vk.updateBlas(geom.model_id);
+    }
+    app_syncInstances(cur_mesh, geom.model_id);
+  }
+  // 实例的修改只记入dirty集合，render()中追踪前执行一次TLAS更新或重建
+}
+
+void HdGatlingRenderPass::app_syncInstances(_MeshPrim& mesh, int model_id)
+{
+  HelloVulkan& vk = _renderApp.getVulkan();
+  size_t count = mesh._transforms.size();
+  size_t existing = std::min(count, mesh.instance_ids.size());
+  for(size_t k = 0; k < existing; ++k){
+    int inst = mesh.instance_ids[k];
+    if(vk.m_instances[inst].objIndex != static_cast<uint32_t>(model_id)){
+      vk.setInstanceObject(inst, model_id);
+    }
+    if(!vk.m_instances[inst].visible){
+      vk.setInstanceVisible(inst, true);
+    }
+    vk.setInstanceTransform(inst, mesh._transforms[k]);
+  }
+  // 实例数减少：隐藏多出的实例，序号保留给之后再增加时复用
+  for(size_t k = count; k < mesh.instance_ids.size(); ++k){
+    vk.setInstanceVisible(mesh.instance_ids[k], false);
+  }
+  // 实例数增加：一次追加全部新实例，TLAS在本帧追踪前重建
+  if(count > mesh.instance_ids.size()){
+    std::vector<glm::mat4> added(mesh._transforms.begin() + mesh.instance_ids.size(), mesh._transforms.end());
+    int first = static_cast<int>(vk.addInstances(model_id, added));
+    for(size_t k = 0; k < added.size(); ++k){
+      mesh.instance_ids.push_back(first + static_cast<int>(k));
     }
   }
 }
@@ -74,7 +74,11 @@ private:
 // for headless ray trace app
 private:
   void app_updateCamera(const HdCamera& camera);
+  // 把Hydra的渲染设置（spp、反射次数等）交给光追器
+  void app_applySettings();
   void app_init(const HdRenderPassAovBinding& binding);
+  // 让mesh的gpu实例与它的实例变换一致：新增的批量追加，多余的隐藏
+  void app_syncInstances(_MeshPrim& mesh, int model_id);
 
   // 真正的openusd的mesh更新动画
   void app_anim_real();
@@ -1,5 +1,6 @@
 #include <pxr/base/gf/vec3f.h>
 #include "renderScene.h"
+#include <content_hash.hpp>
 #include <iostream>
 #include <iomanip>
 
@@ -87,6 +88,7 @@ void ConvertVmeshToLoader(const _VertexStreams& mesh, ModelLoader& Loader) {
         Loader.m_indices.push_back(static_cast<uint32_t>(face[2]) + vertexOffset);
     }
 
+    Loader.m_matIndx.clear();
     for (const auto& mat_id : mat_idx) {
         Loader.m_matIndx.push_back(static_cast<uint32_t>(mat_id));
     }
@@ -95,6 +97,90 @@ void ConvertVmeshToLoader(const _VertexStreams& mesh, ModelLoader& Loader) {
     vertexOffset += points.size();
 }
 
+template<typename T>
+static uint64_t HashArray(const VtArray<T>& array, uint64_t seed)
+{
+    return contentHash(array.cdata(), array.size() * sizeof(T), seed);
+}
+
+uint64_t HashVertexStreams(const _VertexStreams& streams)
+{
+    uint64_t h = contentHash(streams.faces.cdata(), streams.faces.size() * sizeof(GfVec3i));
+    h = HashArray(streams.points, h);
+    // 共享的是整个顶点buffer，法线、uv和材质索引也必须一致
+    h = HashArray(streams.normals, h);
+    h = HashArray(streams.texCoords, h);
+    return HashArray(streams.materialIds, h);
+}
+
+// 哈希相同时再比较内容，避免碰撞导致两个mesh错误地共享几何
+static bool SameStreams(const _VertexStreams& a, const _VertexStreams& b)
+{
+    return a.faces == b.faces && a.points == b.points && a.normals == b.normals &&
+           a.texCoords == b.texCoords && a.materialIds == b.materialIds;
+}
+
+int HdGatlingScene::AcquireGeometry(const _VertexStreams& streams, uint64_t hash)
+{
+    auto it = geomByHash.find(hash);
+    if (it != geomByHash.end() && SameStreams(v_geom[it->second].streams, streams)) {
+        v_geom[it->second].refCount++;
+        return it->second;
+    }
+
+    int geom_id = static_cast<int>(v_geom.size());
+    _SharedGeometry geom;
+    geom.streams = streams;
+    geom.hash = hash;
+    geom.refCount = 1;
+    v_geom.emplace_back(std::move(geom));
+    // 碰撞时保留注册表中已有的项，新几何不参与共享
+    geomByHash.emplace(hash, geom_id);
+    return geom_id;
+}
+
+void HdGatlingScene::ReleaseGeometry(int geom_id)
+{
+    _SharedGeometry& geom = v_geom[geom_id];
+    if (--geom.refCount > 0) {
+        return;
+    }
+    auto it = geomByHash.find(geom.hash);
+    if (it != geomByHash.end() && it->second == geom_id) {
+        geomByHash.erase(it);
+    }
+    geom.streams = _VertexStreams();
+    geom.changed = false;
+}
+
+int HdGatlingScene::UpdateGeometry(int geom_id, const _VertexStreams& streams, uint64_t hash)
+{
+    if (v_geom[geom_id].hash == hash && SameStreams(v_geom[geom_id].streams, streams)) {
+        return geom_id;
+    }
+
+    auto it = geomByHash.find(hash);
+    bool shareable = it != geomByHash.end() && it->second != geom_id &&
+                     SameStreams(v_geom[it->second].streams, streams);
+    if (v_geom[geom_id].refCount == 1 && !shareable) {
+        // 形变动画的常见情况：只有自己引用，原地更新，gpu端refit同一个BLAS
+        _SharedGeometry& geom = v_geom[geom_id];
+        auto old = geomByHash.find(geom.hash);
+        if (old != geomByHash.end() && old->second == geom_id) {
+            geomByHash.erase(old);
+        }
+        geom.streams = streams;
+        geom.hash = hash;
+        geom.changed = true;
+        geomByHash.emplace(hash, geom_id);
+        return geom_id;
+    }
+
+    // 其他mesh仍在使用旧几何，或新内容可以与已有几何共享
+    ReleaseGeometry(geom_id);
+    return AcquireGeometry(streams, hash);
+}
+
 void add_default_material(ModelLoader& Loader)
 {
     // 2. 创建默认材质
@@ -28,21 +28,52 @@ struct _VertexStreams
     VtVec3fArray normals;
     VtVec2fArray texCoords;
     VtIntArray materialIds;      // 新增：每个面的材质 ID
+};
 
-    bool         _changed;      //是否被更新
-    int          _mesh_id;      //在cpu和gpu的vector中的序号，必须保持一致
-    glm::mat4    _transform;
+// 拓扑+顶点内容完全相同的mesh共享一份几何：cpu端只存一份数据，gpu端只上传一次、只建一个BLAS
+struct _SharedGeometry
+{
+    _VertexStreams streams;
+    uint64_t       hash = 0;        // HashVertexStreams 的结果，作为注册表的键
+    int            refCount = 0;    // 引用这份几何的mesh数，为0时释放cpu端数据
+    int            model_id = -1;   // gpu端模型序号（HelloVulkan::m_objModel），-1表示尚未上传
+    bool           changed = false; // 顶点被原地更新（只有一个引用者时），需要重新上传并refit
+};
+
+// 一个HdGatlingMesh；被点实例化时每个实例变换对应gpu端的一个TLAS实例，共享同一个BLAS
+struct _MeshPrim
+{
+    int                    geom_id = -1;        // 在v_geom中的序号
+    std::vector<int>       instance_ids;        // gpu端实例序号（HelloVulkan::m_instances），与_transforms一一对应，多出的被隐藏
+    std::vector<glm::mat4> _transforms{glm::mat4(1.0f)};        // 每个实例的世界变换，没有instancer时只有一个
+    bool                   _changed = true;     // 变换、实例数或引用的几何改变
+    bool                   removed = false;     // 已从场景删除，gpu端实例被隐藏
 };
 
 struct HdGatlingScene
 {
     //互斥锁，防止多线程mesh抢夺资源崩溃
     std::mutex mutex;
-    // 转化成raytrace可用的mesh格式
-    std::vector<_VertexStreams> v_mesh;
-};
+    // 转化成raytrace可用的mesh格式，按内容去重
+    std::vector<_SharedGeometry> v_geom;
+    // 几何内容哈希 -> v_geom序号
+    std::unordered_map<uint64_t, int> geomByHash;
+    // 每个mesh prim一项，序号即HdGatlingMesh::_mesh_id
+    std::vector<_MeshPrim> v_mesh;
 
+    // 以下函数需在持有mutex时调用
+    // 引用内容为streams的几何：已有相同内容时只增加引用计数，否则新建；返回v_geom序号
+    int  AcquireGeometry(const _VertexStreams& streams, uint64_t hash);
+    // 释放一次引用，计数归零时清空cpu端数据
+    // gpu端模型和BLAS一直保留到渲染器销毁：HelloVulkan::removeModel 会让后面的模型和实例序号前移，
+    // 而 model_id 和 _MeshPrim::instance_ids 都直接保存这些序号
+    void ReleaseGeometry(int geom_id);
+    // mesh的几何内容变化：唯一引用者且新内容没有可共享的几何时原地更新（保持refit路径），否则改为引用其他几何
+    int  UpdateGeometry(int geom_id, const _VertexStreams& streams, uint64_t hash);
+};
 
+// 拓扑、顶点及其属性的内容哈希，相同哈希且内容相等的mesh共享几何
+uint64_t HashVertexStreams(const _VertexStreams& streams);
 
 //添加默认材质
 void add_default_material(ModelLoader& Loader);
@@ -34,6 +34,7 @@ PXR_NAMESPACE_OPEN_SCOPE
   ((mediumStackSize, "medium-stack-size"))                   \
   ((maxVolumeWalkLength, "max-volume-walk-length"))          \
   ((jitteredSampling, "jittered-sampling"))                  \
+  ((pathTracing, "path-tracing"))                            \
   ((clippingPlanes, "clipping-planes"))                      \
   ((metersPerSceneUnit, "meters-per-scene-unit"))
 
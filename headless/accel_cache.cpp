@@ -0,0 +1,121 @@
+#include "accel_cache.hpp"
+#include "content_hash.hpp"
+
+#include "nvh/nvprint.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+// 序列化数据头：driverUUID、兼容性UUID、序列化大小、反序列化大小、句柄数
+static constexpr size_t kHeaderSize = 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t);
+
+//--------------------------------------------------------------------------------------------------
+//
+void AccelCache::init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& directory)
+{
+  m_device    = device;
+  m_directory = directory;
+  if(m_directory.empty())
+    return;
+
+  std::error_code ec;
+  fs::create_directories(m_directory, ec);
+  if(ec)
+  {
+    LOGW("Cannot create acceleration structure cache directory %s, cache disabled\n", m_directory.c_str());
+    m_directory.clear();
+    return;
+  }
+
+  VkPhysicalDeviceIDProperties idProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+  VkPhysicalDeviceProperties2  properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &idProperties;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+  m_deviceHash = contentHash(idProperties.deviceUUID, VK_UUID_SIZE);
+  m_deviceHash = contentHash(idProperties.driverUUID, VK_UUID_SIZE, m_deviceHash);
+  m_deviceHash = contentHash(&properties.properties.driverVersion, sizeof(uint32_t), m_deviceHash);
+}
+
+uint64_t AccelCache::makeKey(uint64_t geometryHash, VkBuildAccelerationStructureFlagsKHR flags, const std::vector<uint32_t>& primitiveCounts) const
+{
+  uint64_t key = contentHash(&geometryHash, sizeof(geometryHash), m_deviceHash);
+  key          = contentHash(&flags, sizeof(flags), key);
+  return contentHash(primitiveCounts.data(), primitiveCounts.size() * sizeof(uint32_t), key);
+}
+
+std::string AccelCache::path(uint64_t key) const
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.blas", static_cast<unsigned long long>(key));
+  return (fs::path(m_directory) / name).string();
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+bool AccelCache::load(uint64_t key, std::vector<uint8_t>& data) const
+{
+  if(!isEnabled())
+    return false;
+
+  std::ifstream file(path(key), std::ios::binary | std::ios::ate);
+  if(!file)
+    return false;
+  auto size = static_cast<size_t>(file.tellg());
+  if(size < kHeaderSize)
+    return false;
+  data.resize(size);
+  file.seekg(0);
+  if(!file.read(reinterpret_cast<char*>(data.data()), size))
+    return false;
+
+  // 数据头中的序列化大小必须和文件一致（写入中断的文件会被拒绝）
+  uint64_t serializedSize;
+  memcpy(&serializedSize, data.data() + 2 * VK_UUID_SIZE, sizeof(uint64_t));
+  if(serializedSize != size)
+    return false;
+
+  VkAccelerationStructureVersionInfoKHR versionInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR};
+  versionInfo.pVersionData = data.data();
+  VkAccelerationStructureCompatibilityKHR compatibility{VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR};
+  vkGetDeviceAccelerationStructureCompatibilityKHR(m_device, &versionInfo, &compatibility);
+  if(compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR)
+  {
+    LOGW("Cached acceleration structure %s is not compatible with this device, rebuilding\n", path(key).c_str());
+    return false;
+  }
+  return true;
+}
+
+void AccelCache::store(uint64_t key, const void* data, size_t size) const
+{
+  if(!isEnabled())
+    return;
+
+  std::string target = path(key);
+  std::string temp   = target + ".tmp";
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if(!file.write(static_cast<const char*>(data), size))
+    {
+      LOGW("Failed to write acceleration structure cache %s\n", temp.c_str());
+      return;
+    }
+  }
+  std::error_code ec;
+  fs::rename(temp, target, ec);
+  if(ec)
+    fs::remove(temp, ec);
+}
+
+VkDeviceSize AccelCache::deserializedSize(const std::vector<uint8_t>& data)
+{
+  uint64_t size = 0;
+  if(data.size() >= kHeaderSize)
+    memcpy(&size, data.data() + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+  return size;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// 加速结构的磁盘缓存
+// - 数据是 vkCmdCopyAccelerationStructureToMemoryKHR 序列化的结果，每个BLAS一个文件
+// - 文件名由几何哈希、构建标志、图元数以及设备/驱动UUID组成，换显卡或驱动后自然不命中
+// - 读取时再用 vkGetDeviceAccelerationStructureCompatibilityKHR 检查数据头，不兼容则视为未命中
+//
+class AccelCache
+{
+public:
+  // directory 为空表示禁用缓存
+  void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& directory);
+  bool isEnabled() const { return !m_directory.empty(); }
+
+  // 缓存键：几何内容 + 影响BLAS结果的构建参数 + 设备身份
+  uint64_t makeKey(uint64_t geometryHash, VkBuildAccelerationStructureFlagsKHR flags, const std::vector<uint32_t>& primitiveCounts) const;
+
+  // 读取序列化数据；文件不存在、损坏或与当前设备不兼容时返回 false
+  bool load(uint64_t key, std::vector<uint8_t>& data) const;
+  // 写入序列化数据（先写临时文件再改名，避免并发进程读到半个文件）
+  void store(uint64_t key, const void* data, size_t size) const;
+
+  // 序列化数据头中记录的反序列化后大小（用于创建BLAS）
+  static VkDeviceSize deserializedSize(const std::vector<uint8_t>& data);
+
+private:
+  std::string path(uint64_t key) const;
+
+  VkDevice    m_device{VK_NULL_HANDLE};
+  std::string m_directory;
+  uint64_t    m_deviceHash{0};  // deviceUUID + driverUUID + driverVersion
+};
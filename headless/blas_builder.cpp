@@ -0,0 +1,748 @@
+#include "blas_builder.hpp"
+
+#include "nvh/nvprint.hpp"
+#include "nvvk/buffers_vk.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+static VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a)
+{
+  return (v + a - 1) / a * a;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void BlasBuilder::init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, nvvk::ResourceAllocator* alloc)
+{
+  m_device         = device;
+  m_physicalDevice = physicalDevice;
+  m_alloc          = alloc;
+  m_cmdPool.init(device, queueFamily);
+
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &asProperties;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+  m_scratchAlignment = std::max<VkDeviceSize>(asProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+
+  // 创建设备时传入了 VkPhysicalDeviceAccelerationStructureFeaturesKHR，支持的特性都已启用
+  VkPhysicalDeviceAccelerationStructureFeaturesKHR asFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR};
+  VkPhysicalDeviceFeatures2 features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  features.pNext = &asFeatures;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+  m_hostCommands = asFeatures.accelerationStructureHostCommands == VK_TRUE;
+}
+
+void BlasBuilder::setHostBuild(bool enable, uint32_t threads)
+{
+  if(enable && !m_hostCommands)
+    LOGI("Host acceleration structure builds are not supported, BLAS are built on the device\n");
+  m_hostBuild   = enable && m_hostCommands;
+  m_hostThreads = threads;
+}
+
+void BlasBuilder::deinit()
+{
+  if(m_device == VK_NULL_HANDLE)
+    return;
+  clear();
+  m_alloc->destroy(m_scratch);
+  m_scratchSize = 0;
+  m_cmdPool.deinit();
+  m_device = VK_NULL_HANDLE;
+}
+
+void BlasBuilder::clear()
+{
+  for(auto& e : m_entries)
+    m_alloc->destroy(e.as);
+  m_entries.clear();
+  m_rebuildQueue.clear();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 静态网格优先追踪性能并允许压缩；可变形网格优先构建速度并允许refit
+VkBuildAccelerationStructureFlagsKHR BlasBuilder::flagsFor(BlasUsage usage, bool compaction)
+{
+  if(usage == BlasUsage::eDeformable)
+    return VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+  VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+  if(compaction)
+    flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+  return flags;
+}
+
+VkAccelerationStructureBuildGeometryInfoKHR BlasBuilder::makeBuildInfo(const BlasInput& input, VkBuildAccelerationStructureFlagsKHR flags, bool host) const
+{
+  const auto& geometry = host ? input.hostGeometry : input.asGeometry;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+  buildInfo.mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  buildInfo.flags         = flags;
+  buildInfo.geometryCount = static_cast<uint32_t>(geometry.size());
+  buildInfo.pGeometries   = geometry.data();
+  return buildInfo;
+}
+
+VkAccelerationStructureBuildSizesInfoKHR BlasBuilder::querySizes(const VkAccelerationStructureBuildGeometryInfoKHR& buildInfo,
+                                                                 const std::vector<uint32_t>& counts,
+                                                                 bool                         host) const
+{
+  VkAccelerationStructureBuildSizesInfoKHR sizeInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  vkGetAccelerationStructureBuildSizesKHR(m_device, host ? VK_ACCELERATION_STRUCTURE_BUILD_TYPE_HOST_KHR : VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+                                          &buildInfo, counts.data(), &sizeInfo);
+  return sizeInfo;
+}
+
+// host: 放在host可见的内存中，供 vkBuildAccelerationStructuresKHR 写入，设备仍按地址引用
+nvvk::AccelKHR BlasBuilder::createAccel(VkDeviceSize size, bool host)
+{
+  VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+  createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+  createInfo.size = size;
+  if(!host)
+    return m_alloc->createAcceleration(createInfo);
+
+  nvvk::AccelKHR as;
+  as.buffer = m_alloc->createBuffer(size, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  createInfo.buffer = as.buffer.buffer;
+  vkCreateAccelerationStructureKHR(m_device, &createInfo, nullptr, &as.accel);
+
+  VkAccelerationStructureDeviceAddressInfoKHR addressInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR};
+  addressInfo.accelerationStructure = as.accel;
+  as.address                        = vkGetAccelerationStructureDeviceAddressKHR(m_device, &addressInfo);
+  return as;
+}
+
+// 返回至少 size 字节、按 minAccelerationStructureScratchOffsetAlignment 对齐的scratch地址
+// 调用者保证之前使用scratch的构建已经完成
+VkDeviceAddress BlasBuilder::getScratch(VkDeviceSize size)
+{
+  if(size > m_scratchSize)
+  {
+    m_alloc->destroy(m_scratch);
+    m_scratch     = m_alloc->createBuffer(size + m_scratchAlignment,
+                                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_scratchSize = size;
+  }
+  return alignUp(nvvk::getBufferDeviceAddress(m_device, m_scratch.buffer), m_scratchAlignment);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 分批构建所有BLAS
+// - 按scratch预算分批：一批内的BLAS各占共享scratch中的一段，用一次 vkCmdBuildAccelerationStructuresKHR 并行构建
+// - BLAS在所属批次开始时才创建，压缩后立即销毁未压缩的原BLAS，同一时刻只有一到两批未压缩的BLAS
+// - 上一批的压缩拷贝和下一批的构建录制在同一个命令缓冲中，压缩不需要额外的提交
+// 单个BLAS的scratch超过预算时单独成批，scratch按需增长
+// 开启host构建时，带有host几何的静态BLAS先在host上构建（见 buildOnHost），其余的在设备上分批构建
+void BlasBuilder::build(const std::vector<BlasInput>& inputs)
+{
+  if(inputs.empty())
+    return;
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  const auto first = static_cast<uint32_t>(m_entries.size());
+  const auto count = static_cast<uint32_t>(inputs.size());
+  m_entries.resize(first + count);
+  m_stats           = {};
+  m_stats.blasCount = count;
+
+  // 查询所有BLAS的大小
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(count);
+  std::vector<VkAccelerationStructureBuildSizesInfoKHR>    sizeInfos(count);
+  uint32_t                                                 compactCount = 0;
+  for(uint32_t i = 0; i < count; i++)
+  {
+    Entry& entry = m_entries[first + i];
+    entry.usage  = inputs[i].usage;
+    entry.host   = m_hostBuild && entry.usage == BlasUsage::eStatic && !inputs[i].hostGeometry.empty();
+    entry.flags  = flagsFor(entry.usage, m_compaction && !entry.host);
+    entry.input  = inputs[i];
+    entry.primitiveCounts.clear();
+    for(const auto& range : inputs[i].asBuildOffsetInfo)
+      entry.primitiveCounts.push_back(range.primitiveCount);
+
+    buildInfos[i] = makeBuildInfo(inputs[i], entry.flags, entry.host);
+    sizeInfos[i]  = querySizes(buildInfos[i], entry.primitiveCounts, entry.host);
+    m_stats.originalBytes += sizeInfos[i].accelerationStructureSize;
+
+    // 只缓存压缩后的静态BLAS
+    bool cacheable = m_cache.isEnabled() && inputs[i].geometryHash != 0
+                     && (entry.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR);
+    entry.cacheKey = cacheable ? m_cache.makeKey(inputs[i].geometryHash, entry.flags, entry.primitiveCounts) : 0;
+  }
+  m_stats.finalBytes = m_stats.originalBytes;
+
+  // 磁盘缓存命中的BLAS直接反序列化，不参与构建
+  std::vector<bool> loaded = loadFromCache(first, count, sizeInfos);
+  for(uint32_t i = 0; i < count; i++)
+  {
+    if(!loaded[i] && (m_entries[first + i].flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR))
+      compactCount++;
+  }
+
+  if(m_hostBuild)
+    buildOnHost(first, inputs, buildInfos, sizeInfos);
+
+  VkQueryPool queryPool{VK_NULL_HANDLE};
+  if(compactCount > 0)
+  {
+    VkQueryPoolCreateInfo qpci{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    qpci.queryCount = compactCount;
+    qpci.queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+    vkCreateQueryPool(m_device, &qpci, nullptr, &queryPool);
+  }
+
+  // 构建完成后，下一批才能复用scratch；同一屏障也保证压缩查询和拷贝读到完整的BLAS
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+
+  CompactBatch pending;  // 上一批中等待压缩的BLAS
+  uint32_t     next       = 0;
+  uint32_t     queryIndex = 0;
+  bool         firstBatch = true;
+  auto skip = [&](uint32_t i) { return loaded[i] || m_entries[first + i].host; };
+  while(next < count && skip(next))
+    next++;
+  while(next < count || !pending.entries.empty())
+  {
+    VkCommandBuffer cmdBuf = m_cmdPool.createCommandBuffer();
+    if(firstBatch && queryPool)
+      vkCmdResetQueryPool(cmdBuf, queryPool, 0, compactCount);
+    firstBatch = false;
+
+    // 1. 上一批的压缩拷贝
+    std::vector<nvvk::AccelKHR> cleanup;
+    if(!pending.entries.empty())
+      recordCompaction(cmdBuf, pending, queryPool, cleanup);
+
+    // 2. 在预算内选取本批的BLAS
+    CompactBatch current;
+    current.firstQuery = queryIndex;
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR>     batchInfos;
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> batchRanges;
+    std::vector<VkAccelerationStructureKHR>                      batchCompact;  // 本批需要压缩的BLAS
+    std::vector<VkDeviceSize>                                    scratchOffsets;
+    VkDeviceSize                                                 scratchSize = 0;
+    while(next < count)
+    {
+      if(skip(next))
+      {
+        next++;
+        continue;
+      }
+      VkDeviceSize needed = alignUp(sizeInfos[next].buildScratchSize, m_scratchAlignment);
+      if(!batchInfos.empty() && scratchSize + needed > m_scratchBudget)
+        break;
+
+      Entry& entry = m_entries[first + next];
+      entry.as     = createAccel(sizeInfos[next].accelerationStructureSize);
+      buildInfos[next].dstAccelerationStructure = entry.as.accel;
+      batchInfos.push_back(buildInfos[next]);
+      batchRanges.push_back(inputs[next].asBuildOffsetInfo.data());
+      scratchOffsets.push_back(scratchSize);
+      scratchSize += needed;
+
+      if(entry.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR)
+      {
+        current.entries.push_back(first + next);
+        current.originalSizes.push_back(sizeInfos[next].accelerationStructureSize);
+        batchCompact.push_back(entry.as.accel);
+      }
+      next++;
+    }
+
+    // 3. 本批一次构建，随后写入压缩大小查询
+    if(!batchInfos.empty())
+    {
+      VkDeviceAddress scratchAddress = getScratch(scratchSize);
+      for(size_t i = 0; i < batchInfos.size(); i++)
+        batchInfos[i].scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+
+      vkCmdBuildAccelerationStructuresKHR(cmdBuf, static_cast<uint32_t>(batchInfos.size()), batchInfos.data(), batchRanges.data());
+      vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                           VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+      if(!batchCompact.empty())
+      {
+        vkCmdWriteAccelerationStructuresPropertiesKHR(cmdBuf, static_cast<uint32_t>(batchCompact.size()), batchCompact.data(),
+                                                      VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool,
+                                                      queryIndex);
+        queryIndex += static_cast<uint32_t>(batchCompact.size());
+      }
+      m_stats.batchCount++;
+      m_stats.peakScratchBytes = std::max(m_stats.peakScratchBytes, scratchSize);
+    }
+
+    m_cmdPool.submitAndWait(cmdBuf);
+    for(auto& as : cleanup)
+      m_alloc->destroy(as);
+    pending = std::move(current);
+  }
+
+  if(queryPool)
+    vkDestroyQueryPool(m_device, queryPool, nullptr);
+
+  // 新构建的可缓存BLAS写入磁盘
+  storeToCache(first, count, loaded);
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+  m_stats.buildMs = elapsed.count();
+
+  double savedPercent = m_stats.originalBytes ? 100.0 * double(m_stats.originalBytes - m_stats.finalBytes) / double(m_stats.originalBytes) : 0.0;
+  LOGI("BLAS build: %u BLAS (%u compacted, %u from cache, %u cached, %u on host) in %u batches, %.2f ms, scratch %.2f MB, %.2f MB -> %.2f MB (%.1f%% saved)\n",
+       m_stats.blasCount, m_stats.compactedCount, m_stats.loadedCount, m_stats.storedCount, m_stats.hostCount, m_stats.batchCount,
+       m_stats.buildMs, m_stats.peakScratchBytes / 1048576.0, m_stats.originalBytes / 1048576.0,
+       m_stats.finalBytes / 1048576.0, savedPercent);
+}
+
+//--------------------------------------------------------------------------------------------------
+// host端构建（VK_KHR_deferred_host_operations）
+// - 按scratch预算分批，每批一次 vkBuildAccelerationStructuresKHR，由一个deferred operation承载，多个线程共同执行
+// - 几何数据和scratch都在host内存中，BLAS写入host可见的buffer，设备追踪时按地址引用
+// - 队列在构建期间保持空闲，软件实现和支持host构建的驱动可以用满全部CPU核心
+void BlasBuilder::buildOnHost(uint32_t                                                     first,
+                              const std::vector<BlasInput>&                                inputs,
+                              std::vector<VkAccelerationStructureBuildGeometryInfoKHR>&    buildInfos,
+                              const std::vector<VkAccelerationStructureBuildSizesInfoKHR>& sizeInfos)
+{
+  const auto count = static_cast<uint32_t>(inputs.size());
+  uint32_t   next  = 0;
+  while(true)
+  {
+    std::vector<uint32_t>     batch;
+    std::vector<VkDeviceSize> scratchOffsets;
+    VkDeviceSize              scratchSize = 0;
+    while(next < count)
+    {
+      if(!m_entries[first + next].host)
+      {
+        next++;
+        continue;
+      }
+      VkDeviceSize needed = alignUp(sizeInfos[next].buildScratchSize, m_scratchAlignment);
+      if(!batch.empty() && scratchSize + needed > m_scratchBudget)
+        break;
+      batch.push_back(next++);
+      scratchOffsets.push_back(scratchSize);
+      scratchSize += needed;
+    }
+    if(batch.empty())
+      break;
+
+    std::vector<uint8_t> scratch(scratchSize + m_scratchAlignment);
+    auto scratchBase = alignUp(reinterpret_cast<VkDeviceSize>(scratch.data()), m_scratchAlignment);
+
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR>     batchInfos;
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> batchRanges;
+    for(size_t k = 0; k < batch.size(); k++)
+    {
+      const uint32_t i     = batch[k];
+      Entry&         entry = m_entries[first + i];
+      entry.as             = createAccel(sizeInfos[i].accelerationStructureSize, true);
+      buildInfos[i].dstAccelerationStructure = entry.as.accel;
+      buildInfos[i].scratchData.hostAddress  = reinterpret_cast<void*>(scratchBase + scratchOffsets[k]);
+      batchInfos.push_back(buildInfos[i]);
+      batchRanges.push_back(inputs[i].asBuildOffsetInfo.data());
+    }
+
+    VkDeferredOperationKHR operation{VK_NULL_HANDLE};
+    vkCreateDeferredOperationKHR(m_device, nullptr, &operation);
+    VkResult result = vkBuildAccelerationStructuresKHR(m_device, operation, static_cast<uint32_t>(batchInfos.size()),
+                                                       batchInfos.data(), batchRanges.data());
+    if(result == VK_OPERATION_DEFERRED_KHR)
+      result = joinDeferredOperation(operation);
+    else if(result == VK_OPERATION_NOT_DEFERRED_KHR)
+      result = VK_SUCCESS;  // 驱动在调用中同步完成了构建
+    vkDestroyDeferredOperationKHR(m_device, operation, nullptr);
+    if(result != VK_SUCCESS)
+      LOGE("Host BLAS build failed (VkResult %d)\n", result);
+
+    m_stats.hostCount += static_cast<uint32_t>(batch.size());
+    m_stats.batchCount++;
+    m_stats.peakScratchBytes = std::max(m_stats.peakScratchBytes, scratchSize);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// 多个线程调用 vkDeferredOperationJoinKHR 共同完成一个deferred operation，当前线程也参与
+// 线程数取驱动报告的最大并发数，不超过 m_hostThreads（0 时为硬件线程数）
+VkResult BlasBuilder::joinDeferredOperation(VkDeferredOperationKHR operation)
+{
+  uint32_t threads = m_hostThreads > 0 ? m_hostThreads : std::max(1u, std::thread::hardware_concurrency());
+  threads          = std::max(1u, std::min(threads, vkGetDeferredOperationMaxConcurrencyKHR(m_device, operation)));
+
+  auto worker = [this, operation]() {
+    while(true)
+    {
+      VkResult result = vkDeferredOperationJoinKHR(m_device, operation);
+      // VK_THREAD_IDLE_KHR：暂时没有可分的工作，稍后再试；其他结果表示本线程已无事可做
+      if(result != VK_THREAD_IDLE_KHR)
+        return;
+      std::this_thread::yield();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for(uint32_t t = 1; t < threads; t++)
+    workers.emplace_back(worker);
+  worker();
+  for(auto& w : workers)
+    w.join();
+  return vkGetDeferredOperationResultKHR(m_device, operation);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 读取一批BLAS的压缩大小，创建压缩后的BLAS并录制拷贝；原BLAS放入 cleanup，在命令完成后销毁
+void BlasBuilder::recordCompaction(VkCommandBuffer cmdBuf, const CompactBatch& batch, VkQueryPool queryPool, std::vector<nvvk::AccelKHR>& cleanup)
+{
+  std::vector<VkDeviceSize> compactSizes(batch.entries.size());
+  vkGetQueryPoolResults(m_device, queryPool, batch.firstQuery, static_cast<uint32_t>(compactSizes.size()),
+                        compactSizes.size() * sizeof(VkDeviceSize), compactSizes.data(), sizeof(VkDeviceSize),
+                        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+
+  for(size_t i = 0; i < batch.entries.size(); i++)
+  {
+    Entry& entry = m_entries[batch.entries[i]];
+
+    nvvk::AccelKHR compacted = createAccel(compactSizes[i]);
+    VkCopyAccelerationStructureInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR};
+    copyInfo.src  = entry.as.accel;
+    copyInfo.dst  = compacted.accel;
+    copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+    vkCmdCopyAccelerationStructureKHR(cmdBuf, &copyInfo);
+
+    cleanup.push_back(entry.as);
+    entry.as = compacted;
+    m_stats.finalBytes -= batch.originalSizes[i] - std::min(batch.originalSizes[i], compactSizes[i]);
+    m_stats.compactedCount++;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// 读取命中的缓存并反序列化（VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR）
+// 数据经由host可见的buffer上传，按scratch预算分组，每组一次提交，内存中最多保留一组文件数据
+std::vector<bool> BlasBuilder::loadFromCache(uint32_t first, uint32_t count, const std::vector<VkAccelerationStructureBuildSizesInfoKHR>& sizeInfos)
+{
+  std::vector<bool> loaded(count, false);
+  if(!m_cache.isEnabled())
+    return loaded;
+
+  struct Item
+  {
+    uint32_t             index{0};
+    std::vector<uint8_t> data;
+  };
+  std::vector<Item> group;
+  VkDeviceSize      groupSize = 0;
+
+  // 序列化数据按256字节对齐放入同一个buffer，一次提交全部反序列化
+  auto flush = [&]() {
+    if(group.empty())
+      return;
+    nvvk::Buffer staging = m_alloc->createBuffer(groupSize + 256,
+                                                 VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VkDeviceAddress base   = alignUp(nvvk::getBufferDeviceAddress(m_device, staging.buffer), 256);
+    VkDeviceSize    skew   = base - nvvk::getBufferDeviceAddress(m_device, staging.buffer);
+    auto            mapped = static_cast<uint8_t*>(m_alloc->map(staging)) + skew;
+    VkCommandBuffer cmdBuf = m_cmdPool.createCommandBuffer();
+    VkDeviceSize    offset = 0;
+    for(const Item& item : group)
+    {
+      Entry& entry = m_entries[first + item.index];
+      memcpy(mapped + offset, item.data.data(), item.data.size());
+
+      VkDeviceSize asSize = AccelCache::deserializedSize(item.data);
+      entry.as            = createAccel(asSize);
+
+      VkCopyMemoryToAccelerationStructureInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR};
+      copyInfo.src.deviceAddress = base + offset;
+      copyInfo.dst               = entry.as.accel;
+      copyInfo.mode              = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR;
+      vkCmdCopyMemoryToAccelerationStructureKHR(cmdBuf, &copyInfo);
+
+      VkDeviceSize estimated = sizeInfos[item.index].accelerationStructureSize;
+      m_stats.finalBytes -= estimated - std::min(estimated, asSize);
+      m_stats.loadedCount++;
+      loaded[item.index] = true;
+      offset += alignUp(item.data.size(), 256);
+    }
+    m_cmdPool.submitAndWait(cmdBuf);
+    m_alloc->unmap(staging);
+    m_alloc->destroy(staging);
+    group.clear();
+    groupSize = 0;
+  };
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    Item item;
+    item.index = i;
+    if(m_entries[first + i].cacheKey == 0 || !m_cache.load(m_entries[first + i].cacheKey, item.data))
+      continue;
+    VkDeviceSize size = alignUp(item.data.size(), 256);
+    if(!group.empty() && groupSize + size > m_scratchBudget)
+      flush();
+    groupSize += size;
+    group.push_back(std::move(item));
+  }
+  flush();
+  return loaded;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 序列化新构建的可缓存BLAS并写入磁盘：先查询序列化大小，再按预算分组拷贝到host可见的buffer
+void BlasBuilder::storeToCache(uint32_t first, uint32_t count, const std::vector<bool>& loaded)
+{
+  std::vector<uint32_t> indices;
+  for(uint32_t i = 0; i < count; i++)
+  {
+    if(!loaded[i] && m_entries[first + i].cacheKey != 0)
+      indices.push_back(first + i);
+  }
+  if(indices.empty())
+    return;
+
+  std::vector<VkAccelerationStructureKHR> handles;
+  for(uint32_t index : indices)
+    handles.push_back(m_entries[index].as.accel);
+
+  VkQueryPool           queryPool;
+  VkQueryPoolCreateInfo qpci{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  qpci.queryCount = static_cast<uint32_t>(indices.size());
+  qpci.queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR;
+  vkCreateQueryPool(m_device, &qpci, nullptr, &queryPool);
+
+  VkCommandBuffer cmdBuf = m_cmdPool.createCommandBuffer();
+  vkCmdResetQueryPool(cmdBuf, queryPool, 0, qpci.queryCount);
+  vkCmdWriteAccelerationStructuresPropertiesKHR(cmdBuf, qpci.queryCount, handles.data(),
+                                                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, queryPool, 0);
+  m_cmdPool.submitAndWait(cmdBuf);
+
+  std::vector<VkDeviceSize> sizes(indices.size());
+  vkGetQueryPoolResults(m_device, queryPool, 0, qpci.queryCount, sizes.size() * sizeof(VkDeviceSize), sizes.data(),
+                        sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+  vkDestroyQueryPool(m_device, queryPool, nullptr);
+
+  size_t start = 0;
+  while(start < indices.size())
+  {
+    size_t       end  = start;
+    VkDeviceSize size = 0;
+    while(end < indices.size() && (end == start || size + alignUp(sizes[end], 256) <= m_scratchBudget))
+      size += alignUp(sizes[end++], 256);
+
+    nvvk::Buffer readback = m_alloc->createBuffer(size + 256, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                                      | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    VkDeviceAddress base   = alignUp(nvvk::getBufferDeviceAddress(m_device, readback.buffer), 256);
+    VkDeviceSize    skew   = base - nvvk::getBufferDeviceAddress(m_device, readback.buffer);
+    VkDeviceSize    offset = 0;
+    cmdBuf                 = m_cmdPool.createCommandBuffer();
+    for(size_t k = start; k < end; k++)
+    {
+      VkCopyAccelerationStructureToMemoryInfoKHR copyInfo{VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR};
+      copyInfo.src               = handles[k];
+      copyInfo.dst.deviceAddress = base + offset;
+      copyInfo.mode              = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR;
+      vkCmdCopyAccelerationStructureToMemoryKHR(cmdBuf, &copyInfo);
+      offset += alignUp(sizes[k], 256);
+    }
+    m_cmdPool.submitAndWait(cmdBuf);
+
+    auto mapped = static_cast<const uint8_t*>(m_alloc->map(readback)) + skew;
+    offset      = 0;
+    for(size_t k = start; k < end; k++)
+    {
+      m_cache.store(m_entries[indices[k]].cacheKey, mapped + offset, sizes[k]);
+      offset += alignUp(sizes[k], 256);
+      m_stats.storedCount++;
+    }
+    m_alloc->unmap(readback);
+    m_alloc->destroy(readback);
+    start = end;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// refit（mode UPDATE，src=dst），之后按策略判断是否需要排队重建
+// 不能refit时（静态BLAS或图元数改变）立即重新创建
+bool BlasBuilder::update(uint32_t index, const BlasInput& input, float areaRatio)
+{
+  Entry& entry = m_entries[index];
+
+  std::vector<uint32_t> counts;
+  for(const auto& range : input.asBuildOffsetInfo)
+    counts.push_back(range.primitiveCount);
+
+  bool canRefit = (entry.flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) && counts == entry.primitiveCounts;
+  if(!canRefit && entry.usage == BlasUsage::eStatic)
+  {
+    // 静态BLAS不能refit：重新归类为可变形，之后的更新都走refit
+    LOGI("BLAS %u is updated, reclassified as deformable\n", index);
+    entry.usage = BlasUsage::eDeformable;
+  }
+  entry.input = input;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo = makeBuildInfo(input, flagsFor(entry.usage, m_compaction));
+  auto                                        sizeInfo  = querySizes(buildInfo, counts);
+
+  nvvk::AccelKHR oldAs;
+  if(canRefit)
+  {
+    buildInfo.mode                      = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+    buildInfo.srcAccelerationStructure  = entry.as.accel;
+    buildInfo.dstAccelerationStructure  = entry.as.accel;
+    buildInfo.scratchData.deviceAddress = getScratch(sizeInfo.updateScratchSize);
+  }
+  else
+  {
+    oldAs                               = entry.as;
+    entry.as                            = createAccel(sizeInfo.accelerationStructureSize);
+    entry.flags                         = buildInfo.flags;
+    entry.primitiveCounts               = counts;
+    buildInfo.dstAccelerationStructure  = entry.as.accel;
+    buildInfo.scratchData.deviceAddress = getScratch(sizeInfo.buildScratchSize);
+  }
+
+  VkCommandBuffer                                 cmdBuf  = m_cmdPool.createCommandBuffer();
+  const VkAccelerationStructureBuildRangeInfoKHR* pRanges = input.asBuildOffsetInfo.data();
+  vkCmdBuildAccelerationStructuresKHR(cmdBuf, 1, &buildInfo, &pRanges);
+  m_cmdPool.submitAndWait(cmdBuf);
+
+  if(!canRefit)
+  {
+    m_alloc->destroy(oldAs);
+    entry.ratio = areaRatio;
+    resetQuality(entry);
+    m_frame.rebuilds++;
+    return true;
+  }
+
+  // 质量跟踪：refit次数和表面积增长
+  m_frame.refits++;
+  entry.refitCount++;
+  entry.ratio = areaRatio;
+  if(entry.baseRatio <= 0.0f)
+    entry.baseRatio = areaRatio;
+
+  bool tooManyRefits = m_policy.maxRefits > 0 && entry.refitCount >= m_policy.maxRefits;
+  bool tooMuchGrowth = m_policy.maxAreaGrowth > 0.0f && getAreaGrowth(index) >= m_policy.maxAreaGrowth;
+  if((tooManyRefits || tooMuchGrowth) && !entry.queued)
+  {
+    entry.queued = true;
+    m_rebuildQueue.push_back(index);
+  }
+  return false;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 排队的重建：用最近一次的几何输入以 BUILD 模式写回同一个BLAS
+// 标志和图元数与原来相同，大小不变，所以可以原地重建，设备地址不变
+uint32_t BlasBuilder::endFrame()
+{
+  uint32_t rebuilt = 0;
+  if(!m_rebuildQueue.empty() && m_policy.maxRebuildsPerFrame > 0)
+  {
+    uint32_t count = std::min<uint32_t>(m_policy.maxRebuildsPerFrame, static_cast<uint32_t>(m_rebuildQueue.size()));
+
+    std::vector<VkAccelerationStructureBuildGeometryInfoKHR>     buildInfos(count);
+    std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> ranges(count);
+    std::vector<VkDeviceSize>                                    scratchOffsets(count);
+    VkDeviceSize                                                 scratchSize = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+      Entry& entry  = m_entries[m_rebuildQueue[i]];
+      buildInfos[i] = makeBuildInfo(entry.input, entry.flags);
+      buildInfos[i].dstAccelerationStructure = entry.as.accel;
+      ranges[i]         = entry.input.asBuildOffsetInfo.data();
+      scratchOffsets[i] = scratchSize;
+      scratchSize += alignUp(querySizes(buildInfos[i], entry.primitiveCounts).buildScratchSize, m_scratchAlignment);
+    }
+
+    VkDeviceAddress scratchAddress = getScratch(scratchSize);
+    for(uint32_t i = 0; i < count; i++)
+      buildInfos[i].scratchData.deviceAddress = scratchAddress + scratchOffsets[i];
+
+    VkCommandBuffer cmdBuf = m_cmdPool.createCommandBuffer();
+    vkCmdBuildAccelerationStructuresKHR(cmdBuf, count, buildInfos.data(), ranges.data());
+    m_cmdPool.submitAndWait(cmdBuf);
+
+    for(uint32_t i = 0; i < count; i++)
+    {
+      Entry& entry = m_entries[m_rebuildQueue[i]];
+      entry.queued = false;
+      resetQuality(entry);
+    }
+    m_rebuildQueue.erase(m_rebuildQueue.begin(), m_rebuildQueue.begin() + count);
+    rebuilt = count;
+  }
+
+  m_frame.rebuilds += rebuilt;
+  m_frame.pendingRebuilds = static_cast<uint32_t>(m_rebuildQueue.size());
+  m_lastFrame             = m_frame;
+  m_frame                 = {};
+  return rebuilt;
+}
+
+// 重建后以当前几何作为新的基准
+void BlasBuilder::resetQuality(Entry& entry)
+{
+  entry.refitCount = 0;
+  entry.baseRatio  = entry.ratio;
+}
+
+float BlasBuilder::getAreaGrowth(uint32_t index) const
+{
+  const Entry& entry = m_entries[index];
+  return entry.baseRatio > 0.0f ? entry.ratio / entry.baseRatio : 1.0f;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+float BlasBuilder::surfaceAreaRatio(const void* positions, size_t stride, const uint32_t* indices, uint32_t indexCount)
+{
+  constexpr uint32_t kChunkTriangles = 32;
+
+  auto position = [&](uint32_t index) { return reinterpret_cast<const float*>(static_cast<const uint8_t*>(positions) + stride * index); };
+  auto area     = [](const float* lo, const float* hi) {
+    float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return 2.0f * (dx * dy + dy * dz + dz * dx);
+  };
+
+  float totalLo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float totalHi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  float chunkSum   = 0.0f;
+  for(uint32_t start = 0; start + 3 <= indexCount; start += kChunkTriangles * 3)
+  {
+    float    lo[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float    hi[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    uint32_t end   = std::min(indexCount - indexCount % 3, start + kChunkTriangles * 3);
+    for(uint32_t i = start; i < end; i++)
+    {
+      const float* p = position(indices[i]);
+      for(int c = 0; c < 3; c++)
+      {
+        lo[c] = std::min(lo[c], p[c]);
+        hi[c] = std::max(hi[c], p[c]);
+      }
+    }
+    chunkSum += area(lo, hi);
+    for(int c = 0; c < 3; c++)
+    {
+      totalLo[c] = std::min(totalLo[c], lo[c]);
+      totalHi[c] = std::max(totalHi[c], hi[c]);
+    }
+  }
+
+  float totalArea = indexCount >= 3 ? area(totalLo, totalHi) : 0.0f;
+  return totalArea > 0.0f ? chunkSum / totalArea : 0.0f;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "nvvk/commands_vk.hpp"
+#include "nvvk/resourceallocator_vk.hpp"
+
+#include "accel_cache.hpp"
+
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// BLAS（底层加速结构）构建器
+// - 每个BLAS按用途选择构建标志：
+//   静态网格：PREFER_FAST_TRACE | ALLOW_COMPACTION，构建后查询压缩大小并拷贝到压缩后的BLAS
+//   可变形网格：PREFER_FAST_BUILD | ALLOW_UPDATE，之后可以refit
+// - 对静态BLAS调用 update 时，自动把它重新归类为可变形并重建（地址会改变）
+// - 构建按scratch预算分批，所有批次共用一块scratch，压缩与下一批的构建交错进行
+// - 设置缓存目录后，压缩后的静态BLAS序列化到磁盘，下次启动时按几何哈希直接反序列化（见 AccelCache）
+// - 可变形BLAS记录refit次数和表面积增长估计，超过阈值时排队重建，每帧最多重建若干个（见 BlasRefitPolicy）
+// - 设备支持 accelerationStructureHostCommands 时，静态BLAS可以在host上构建（VK_KHR_deferred_host_operations），
+//   多个工作线程共同执行，不占用队列；host构建的BLAS不压缩、不写磁盘缓存
+//
+// 与 nvvk::RaytracingBuilderKHR 不同，同一批中可以混合压缩和不压缩的BLAS
+//
+enum class BlasUsage
+{
+  eStatic,      // 几何不再变化
+  eDeformable,  // 顶点会被更新（refit）
+};
+
+struct BlasInput
+{
+  std::vector<VkAccelerationStructureGeometryKHR>       asGeometry;
+  std::vector<VkAccelerationStructureBuildRangeInfoKHR> asBuildOffsetInfo;
+  BlasUsage                                             usage{BlasUsage::eStatic};
+  uint64_t                                              geometryHash{0};  // 顶点和索引内容的哈希，0 表示不使用磁盘缓存
+  std::vector<VkAccelerationStructureGeometryKHR>       hostGeometry;  // 同一几何的host地址版本，为空时只能在设备上构建
+};
+
+// 最近一次 build 的统计
+struct BlasBuildStats
+{
+  uint32_t     blasCount{0};
+  uint32_t     compactedCount{0};
+  uint32_t     loadedCount{0};  // 从磁盘缓存反序列化的BLAS数
+  uint32_t     storedCount{0};  // 新写入磁盘缓存的BLAS数
+  uint32_t     hostCount{0};    // 在host上构建的BLAS数
+  uint32_t     batchCount{0};
+  VkDeviceSize peakScratchBytes{0};  // 单批使用的最大scratch
+  VkDeviceSize originalBytes{0};     // 压缩前所有BLAS的大小
+  VkDeviceSize finalBytes{0};        // 压缩后所有BLAS的大小
+  double       buildMs{0.0};         // 构建+压缩的CPU端总耗时（含等待GPU）
+};
+
+// refit 与重建的策略
+// refit只移动包围盒不改变树结构，大幅形变后包围盒相互重叠，追踪变慢，需要周期性地完整重建
+struct BlasRefitPolicy
+{
+  uint32_t maxRefits{256};          // 连续refit次数上限，0 表示不限制
+  float    maxAreaGrowth{1.5f};     // 表面积比值相对上次构建的增长上限，0 表示不检查
+  uint32_t maxRebuildsPerFrame{1};  // 每帧最多执行的排队重建数（分摊到多帧）
+};
+
+// 每帧的计数，endFrame() 时更新
+struct BlasFrameCounters
+{
+  uint32_t refits{0};           // 本帧的refit次数
+  uint32_t rebuilds{0};         // 本帧执行的重建次数（含图元数改变导致的立即重建）
+  uint32_t pendingRebuilds{0};  // 仍在排队的重建数
+};
+
+class BlasBuilder
+{
+public:
+  void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, nvvk::ResourceAllocator* alloc);
+  void deinit();
+
+  // 静态BLAS是否压缩（关闭时用于对比内存和追踪时间）
+  void setCompaction(bool enable) { m_compaction = enable; }
+  bool getCompaction() const { return m_compaction; }
+
+  // 每批构建可用的scratch总量；BLAS越多批次越多，scratch不随场景增长
+  void         setScratchBudget(VkDeviceSize budget) { m_scratchBudget = budget; }
+  VkDeviceSize getScratchBudget() const { return m_scratchBudget; }
+
+  // host构建：设备不支持 accelerationStructureHostCommands 时保持关闭
+  // threads 为参与 deferred operation 的线程数，0 表示驱动允许的最大并发数（不超过硬件线程数）
+  void setHostBuild(bool enable, uint32_t threads = 0);
+  bool getHostBuild() const { return m_hostBuild; }
+  bool supportsHostBuild() const { return m_hostCommands; }
+
+  // 磁盘缓存目录，空字符串表示禁用；需在 init 之后、build 之前设置
+  void setCacheDirectory(const std::string& directory) { m_cache.init(m_device, m_physicalDevice, directory); }
+
+  // 构建 inputs 中的所有BLAS，追加到已有BLAS之后
+  void build(const std::vector<BlasInput>& inputs);
+  // 用新的几何数据更新第 index 个BLAS：可更新且图元数不变时refit，否则立即重建
+  // areaRatio 为 surfaceAreaRatio() 对当前几何的估计，0 表示未知（只按refit次数判断）
+  // 返回 true 表示BLAS被重新创建，设备地址已改变（TLAS实例需要更新引用）
+  bool update(uint32_t index, const BlasInput& input, float areaRatio = 0.0f);
+  // 每帧调用一次：执行至多 maxRebuildsPerFrame 个排队的重建（原地重建，地址不变），更新每帧计数
+  // 返回本帧重建的BLAS数，不为0时TLAS需要更新
+  uint32_t endFrame();
+  // 销毁所有BLAS
+  void clear();
+
+  uint32_t              size() const { return static_cast<uint32_t>(m_entries.size()); }
+  VkDeviceAddress       getAddress(uint32_t index) const { return m_entries[index].as.address; }
+  BlasUsage             getUsage(uint32_t index) const { return m_entries[index].usage; }
+  const BlasBuildStats& getStats() const { return m_stats; }
+
+  void                     setRefitPolicy(const BlasRefitPolicy& policy) { m_policy = policy; }
+  const BlasRefitPolicy&   getRefitPolicy() const { return m_policy; }
+  const BlasFrameCounters& getFrameCounters() const { return m_lastFrame; }
+  uint32_t                 getRefitCount(uint32_t index) const { return m_entries[index].refitCount; }
+  float                    getAreaGrowth(uint32_t index) const;
+
+  static VkBuildAccelerationStructureFlagsKHR flagsFor(BlasUsage usage, bool compaction);
+
+  // 表面积比值：按索引顺序每 32 个三角形为一组，各组AABB表面积之和 / 整体AABB表面积
+  // 拓扑不变时，相邻三角形被形变拉开会使比值增大，近似refit后BVH节点的重叠程度；对均匀缩放不敏感
+  static float surfaceAreaRatio(const void* positions, size_t stride, const uint32_t* indices, uint32_t indexCount);
+
+private:
+  struct Entry
+  {
+    nvvk::AccelKHR                       as;
+    BlasUsage                            usage{BlasUsage::eStatic};
+    VkBuildAccelerationStructureFlagsKHR flags{0};
+    std::vector<uint32_t>                primitiveCounts;  // 每个geometry的图元数，refit时必须一致
+    BlasInput                            input;            // 最近一次的几何输入，排队重建时使用
+    uint32_t                             refitCount{0};    // 上次构建以来的refit次数
+    float                                baseRatio{0.0f};  // 上次构建时的表面积比值
+    float                                ratio{0.0f};      // 最近一次refit的表面积比值
+    bool                                 queued{false};    // 是否在重建队列中
+    uint64_t                             cacheKey{0};      // 磁盘缓存键，0 表示不缓存
+    bool                                 host{false};      // 在host上构建，存放在host可见的内存中
+  };
+
+  VkAccelerationStructureBuildGeometryInfoKHR makeBuildInfo(const BlasInput& input, VkBuildAccelerationStructureFlagsKHR flags, bool host = false) const;
+  VkAccelerationStructureBuildSizesInfoKHR querySizes(const VkAccelerationStructureBuildGeometryInfoKHR& buildInfo,
+                                                      const std::vector<uint32_t>&                       counts,
+                                                      bool                                               host = false) const;
+  nvvk::AccelKHR  createAccel(VkDeviceSize size, bool host = false);
+  VkDeviceAddress getScratch(VkDeviceSize size);
+  // 一批等待压缩的BLAS，查询结果位于 [firstQuery, firstQuery + entries.size())
+  struct CompactBatch
+  {
+    std::vector<uint32_t>     entries;
+    std::vector<VkDeviceSize> originalSizes;
+    uint32_t                  firstQuery{0};
+  };
+  void recordCompaction(VkCommandBuffer cmdBuf, const CompactBatch& batch, VkQueryPool queryPool, std::vector<nvvk::AccelKHR>& cleanup);
+  void resetQuality(Entry& entry);
+  std::vector<bool> loadFromCache(uint32_t first, uint32_t count, const std::vector<VkAccelerationStructureBuildSizesInfoKHR>& sizeInfos);
+  void              storeToCache(uint32_t first, uint32_t count, const std::vector<bool>& loaded);
+  void              buildOnHost(uint32_t                                                     first,
+                                const std::vector<BlasInput>&                                inputs,
+                                std::vector<VkAccelerationStructureBuildGeometryInfoKHR>&    buildInfos,
+                                const std::vector<VkAccelerationStructureBuildSizesInfoKHR>& sizeInfos);
+  VkResult          joinDeferredOperation(VkDeferredOperationKHR operation);
+
+  VkDevice                 m_device{VK_NULL_HANDLE};
+  VkPhysicalDevice         m_physicalDevice{VK_NULL_HANDLE};
+  nvvk::ResourceAllocator* m_alloc{nullptr};
+  nvvk::CommandPool        m_cmdPool;
+
+  bool               m_compaction{true};
+  bool               m_hostCommands{false};  // 设备支持host端的加速结构命令
+  bool               m_hostBuild{false};
+  uint32_t           m_hostThreads{0};
+  std::vector<Entry> m_entries;
+  nvvk::Buffer       m_scratch;  // 所有构建共用，按需增长
+  VkDeviceSize       m_scratchSize{0};
+  VkDeviceSize       m_scratchBudget{128ull << 20};
+  VkDeviceSize       m_scratchAlignment{256};
+  BlasBuildStats     m_stats;
+  AccelCache         m_cache;
+
+  BlasRefitPolicy       m_policy;
+  std::vector<uint32_t> m_rebuildQueue;
+  BlasFrameCounters     m_frame;      // 本帧累计
+  BlasFrameCounters     m_lastFrame;  // 上一帧的结果
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//--------------------------------------------------------------------------------------------------
+// 64位内容哈希，按8字节一组处理，结果与平台无关
+// 用于BLAS磁盘缓存键（AccelCache）和Hydra中按内容去重几何（hdGatling），不依赖Vulkan
+// FNV-1a 的按字处理版本，最后做一次 murmur 风格的混合
+//
+inline uint64_t contentHash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull)
+{
+  constexpr uint64_t kPrime = 0x100000001b3ull;
+
+  auto     bytes = static_cast<const uint8_t*>(data);
+  uint64_t h     = seed ^ size;
+  size_t   i     = 0;
+  for(; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    memcpy(&word, bytes + i, sizeof(word));
+    h = (h ^ word) * kPrime;
+    h ^= h >> 29;  // 把高位的差异带回低位
+  }
+  for(; i < size; i++)
+    h = (h ^ bytes[i]) * kPrime;
+
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  return h;
+}
@@ -0,0 +1,31 @@
+#*****************************************************************************
+# Writes the compiled SPIR-V files into a C++ include as constexpr byte arrays.
+# Run in script mode after compile_glsl_directory:
+#   cmake -DINPUTS="a.spv|b.spv" -DOUTPUT=embedded_spirv.inl -DSTAMP=embedded_spirv.stamp -P embed_spirv.cmake
+# INPUTS is '|' separated because ';' does not survive add_custom_command.
+#*****************************************************************************
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+
+set(ARRAYS "")
+set(TABLE "")
+foreach(INPUT ${INPUTS})
+  get_filename_component(NAME ${INPUT} NAME)
+  string(MAKE_C_IDENTIFIER "spirv_${NAME}" IDENT)
+  file(READ ${INPUT} HEX HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+  string(APPEND ARRAYS "alignas(4) static constexpr unsigned char ${IDENT}[] = {${BYTES}};\n")
+  string(APPEND TABLE "    {\"${NAME}\", ${IDENT}, sizeof(${IDENT})},\n")
+endforeach()
+
+set(CONTENT "// Generated by embed_spirv.cmake from the compiled shaders, do not edit.\n\n")
+string(APPEND CONTENT "${ARRAYS}\n")
+string(APPEND CONTENT "static constexpr EmbeddedSpirv kEmbeddedSpirv[] = {\n${TABLE}};\n")
+
+# Only touch the output when it changed, so unchanged shaders do not recompile the library
+file(WRITE "${OUTPUT}.tmp" "${CONTENT}")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
+
+# The stamp records that the command ran, even when OUTPUT was left untouched
+file(TOUCH "${STAMP}")
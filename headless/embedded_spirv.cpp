@@ -0,0 +1,54 @@
+#include "embedded_spirv.hpp"
+
+#include "nvh/nvprint.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+struct EmbeddedSpirv
+{
+  const char*          name;
+  const unsigned char* code;
+  size_t               size;
+};
+
+#include "embedded_spirv.inl"
+
+std::string g_overrideDirectory;
+
+}  // namespace
+
+namespace spirv {
+
+std::string load(const std::string& name)
+{
+  if(!g_overrideDirectory.empty())
+  {
+    std::ifstream file(std::filesystem::path(g_overrideDirectory) / name, std::ios::binary);
+    if(file)
+      return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  for(const EmbeddedSpirv& shader : kEmbeddedSpirv)
+  {
+    if(name == shader.name)
+      return std::string(reinterpret_cast<const char*>(shader.code), shader.size);
+  }
+  LOGE("SPIR-V %s is not embedded in the library\n", name.c_str());
+  return {};
+}
+
+void setOverrideDirectory(const std::string& directory)
+{
+  g_overrideDirectory = directory;
+}
+
+const std::string& getOverrideDirectory()
+{
+  return g_overrideDirectory;
+}
+
+}  // namespace spirv
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+//--------------------------------------------------------------------------------------------------
+// 编译时嵌入库中的SPIR-V（由 embed_spirv.cmake 在 compile_glsl_directory 之后生成）
+// 启动时不再在多个搜索路径中查找 spv 文件，库可以随Hydra插件任意部署
+// 设置覆盖目录后优先读取该目录下的同名文件，用于不重新编译库就替换着色器
+//
+namespace spirv {
+
+// name 为spv文件名，如 "raytrace.rgen.spv"；找不到时返回空字符串
+// 返回值可直接传给 nvvk::createShaderModule / nvvk::createShaderStageInfo
+std::string load(const std::string& name);
+
+// 覆盖目录，空字符串表示只使用嵌入的SPIR-V
+void               setOverrideDirectory(const std::string& directory);
+const std::string& getOverrideDirectory();
+
+}  // namespace spirv
@@ -26,6 +26,10 @@
 #include "imgui/imgui_camera_widget.h"
 #include "imgui/imgui_helper.h"
 #include <iostream>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "nvh/nvprint.hpp"
 
 //--------------------------------------------------------------------------------------------------
 // 创建应用的所有元素的顺序
@@ -35,6 +39,7 @@
 // 初始化 Imgui 并设置窗口操作的回调函数（鼠标、键盘等）
 void nvvkhl::AppOffline::create(const AppBaseVkCreateInfo& info)
 {
+  m_pipelineCacheDirectory = info.pipelineCacheDirectory;
   // 初始化 Vulkan 相关的实例、设备、物理设备、队列等
   setup(info.instance, info.device, info.physicalDevice, info.queueIndices[0]);
   // 创建命令命令缓冲区
@@ -61,11 +66,94 @@ void nvvkhl::AppOffline::setup(const VkInstance& instance, const VkDevice& devic
   poolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
   vkCreateCommandPool(m_device, &poolCreateInfo, nullptr, &m_cmdPool);
 
-  // 创建管线缓存（可选，提升管线创建效率）
+  // 创建管线缓存，用上次运行保存的数据初始化（冷启动时光追管线的编译占大部分时间）
+  std::vector<char>         cacheData = loadPipelineCacheData();
   VkPipelineCacheCreateInfo pipelineCacheInfo{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  pipelineCacheInfo.initialDataSize = cacheData.size();
+  pipelineCacheInfo.pInitialData    = cacheData.empty() ? nullptr : cacheData.data();
   vkCreatePipelineCache(m_device, &pipelineCacheInfo, nullptr, &m_pipelineCache);
 }
 
+//--------------------------------------------------------------------------------------------------
+// 管线缓存文件：文件名包含 vendor/device ID、驱动版本和 pipelineCacheUUID，驱动升级或换卡后自然失效
+std::string nvvkhl::AppOffline::pipelineCachePath() const
+{
+  if(m_pipelineCacheDirectory.empty())
+    return {};
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+  char name[64];
+  snprintf(name, sizeof(name), "%04x_%04x_%08x_", properties.vendorID, properties.deviceID, properties.driverVersion);
+  std::string file = name;
+  for(uint32_t i = 0; i < VK_UUID_SIZE; i++)
+  {
+    snprintf(name, sizeof(name), "%02x", properties.pipelineCacheUUID[i]);
+    file += name;
+  }
+  return (std::filesystem::path(m_pipelineCacheDirectory) / (file + ".pipelinecache")).string();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 读取管线缓存文件；不存在、被截断或数据头与当前设备不一致时返回空（从空缓存开始）
+std::vector<char> nvvkhl::AppOffline::loadPipelineCacheData() const
+{
+  std::string path = pipelineCachePath();
+  if(path.empty())
+    return {};
+
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if(!file)
+    return {};
+  std::vector<char> data(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if(data.size() < sizeof(VkPipelineCacheHeaderVersionOne) || !file.read(data.data(), data.size()))
+    return {};
+
+  VkPipelineCacheHeaderVersionOne header;
+  memcpy(&header, data.data(), sizeof(header));
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+  if(header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header.vendorID != properties.vendorID
+     || header.deviceID != properties.deviceID || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+  {
+    LOGW("Pipeline cache %s does not match this device, ignored\n", path.c_str());
+    return {};
+  }
+  LOGI("Loaded pipeline cache %s (%zu bytes)\n", path.c_str(), data.size());
+  return data;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 把管线缓存写入磁盘；先写临时文件再改名，多个进程同时退出时不会留下写了一半的文件
+void nvvkhl::AppOffline::savePipelineCache() const
+{
+  std::string path = pipelineCachePath();
+  if(path.empty() || m_pipelineCache == VK_NULL_HANDLE)
+    return;
+
+  size_t size = 0;
+  vkGetPipelineCacheData(m_device, m_pipelineCache, &size, nullptr);
+  std::vector<char> data(size);
+  if(size == 0 || vkGetPipelineCacheData(m_device, m_pipelineCache, &size, data.data()) != VK_SUCCESS)
+    return;
+
+  std::error_code ec;
+  std::filesystem::create_directories(m_pipelineCacheDirectory, ec);
+  std::string temp = path + ".tmp";
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if(!file.write(data.data(), size))
+    {
+      LOGW("Failed to write pipeline cache %s\n", temp.c_str());
+      return;
+    }
+  }
+  std::filesystem::rename(temp, path, ec);
+  if(ec)
+    std::filesystem::remove(temp, ec);
+}
+
 //--------------------------------------------------------------------------------------------------
 // 程序退出时调用，销毁所有 Vulkan 资源
 // 中文注释：销毁所有 Vulkan 相关对象、释放内存、清理 ImGui
@@ -74,7 +162,8 @@ void nvvkhl::AppOffline::destroy()
   // 等待设备空闲，确保没有任务正在运行
   vkDeviceWaitIdle(m_device);
 
-  // 销毁管线缓存
+  // 保存并销毁管线缓存
+  savePipelineCache();
   vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
 
   // 遍历交换链中的每一帧，销毁相关资源
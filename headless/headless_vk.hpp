@@ -25,6 +25,7 @@
 #include <unistd.h>
 #endif
 
+#include <string>
 #include <vector>
 
 namespace nvvkhl {
@@ -36,6 +37,7 @@ struct AppBaseVkCreateInfo
   VkPhysicalDevice      physicalDevice{};
   std::vector<uint32_t> queueIndices{};
   VkExtent2D            size{};
+  std::string           pipelineCacheDirectory{};  // Pipeline cache is loaded from and saved to this directory, empty: memory only
 };
 
 class AppOffline
@@ -82,6 +84,12 @@ protected:
   uint32_t m_imageIndex = 0;
   uint32_t m_imageCount = 1;
 
+  // Pipeline cache on disk, one file per device UUID and driver version
+  std::string       m_pipelineCacheDirectory;
+  std::string       pipelineCachePath() const;
+  std::vector<char> loadPipelineCacheData() const;
+  void              savePipelineCache() const;
+
   // for save color_image to local png file
   uint32_t        getMemoryType(uint32_t typeBits, const VkMemoryPropertyFlags& properties) const;
   VkCommandBuffer createTempCmdBuffer();
@@ -17,16 +17,26 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
 #include <sstream>
+#include <thread>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <glm/glm.hpp>
 #include "stb_image.h"
 
 #include "hello_vulkan.hpp"
+#include "content_hash.hpp"
+#include "embedded_spirv.hpp"
 #include "nvh/alignment.hpp"
 #include "nvh/cameramanipulator.hpp"
 #include "nvh/fileoperations.hpp"
+#include "nvh/nvprint.hpp"
 #include "nvvk/commands_vk.hpp"
 #include "nvvk/descriptorsets_vk.hpp"
 #include "nvvk/images_vk.hpp"
@@ -38,6 +48,10 @@
 
 extern std::vector<std::string> defaultSearchPaths;
 
+// 光追管线中读取 PushConstantRay 的阶段；管线布局的push constant范围和每次 vkCmdPushConstants 都必须使用同一组
+static constexpr VkShaderStageFlags kRtPushStages = VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR
+                                                    | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR;
+
 
 // USE_EGL_CONTEXT always be false,never use it unless you can load opengl funtion under EGL
 // keep it because EGL is real headless, may fix it on future
@@ -137,6 +151,10 @@ void HelloVulkan::setup(const VkInstance& instance, const VkDevice& device, cons
   AppOffline::setup(instance, device, physicalDevice, queueFamily);
   // 初始化资源分配器，用于设备上分配buffer/image等
   m_alloc.init(device, physicalDevice);
+  // 固定大小的上传环形缓冲，大资源分块上传，staging内存不随资源大小增长
+  m_stagingRing.init(device, queueFamily, &m_alloc, m_stagingBudget);
+  // 纹理流式加载（同时管理所有纹理的TextureInfo）
+  m_texStreamer.init(device, queueFamily, &m_alloc, &m_stagingRing);
   // 初始化调试辅助功能（用于对象命名、调试标签等）
   m_debug.setup(m_device);
   // 查找适合的离屏深度格式
@@ -170,6 +188,13 @@ void HelloVulkan::updateUniformBuffer(const VkCommandBuffer& cmdBuf)
   hostUBO.viewInverse = glm::inverse(view);
   hostUBO.projInverse = glm::inverse(proj);
 
+  // 摄像机移动后重新累积
+  if(hostUBO.viewProj != m_accumViewProj)
+  {
+    m_accumViewProj = hostUBO.viewProj;
+    resetAccumulation();
+  }
+
   // 设备端的UBO和所需的访问阶段
   VkBuffer deviceUBO      = m_bGlobals.buffer;
   auto     uboUsageStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
@@ -201,23 +226,40 @@ void HelloVulkan::updateUniformBuffer(const VkCommandBuffer& cmdBuf)
 //--------------------------------------------------------------------------------------------------
 // 创建图形渲染用的描述符集布局
 // 包括：全局UBO，物体描述buffer，所有纹理采样器
+// 纹理数组按最大容量创建（bindless），绑定为 update-after-bind + partially-bound，
+// 这样运行时追加模型/纹理只需写入新的描述符，不需要重建layout和管线
 void HelloVulkan::createDescriptorSetLayout()
 {
-  auto nbTxt = static_cast<uint32_t>(m_textures.size());
+  // 纹理数组容量受设备 update-after-bind 限制
+  VkPhysicalDeviceVulkan12Properties props12{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+  VkPhysicalDeviceProperties2        prop2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  prop2.pNext = &props12;
+  vkGetPhysicalDeviceProperties2(m_physicalDevice, &prop2);
+  m_maxTextures = std::min({m_maxTextures, props12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                            props12.maxDescriptorSetUpdateAfterBindSampledImages});
+  m_maxTextures = std::max(m_maxTextures, static_cast<uint32_t>(m_textures.size()));
 
   // 摄像机矩阵 UBO
   m_descSetLayoutBind.addBinding(SceneBindings::eGlobals, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
                                  VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR);
   // 物体描述 SSBO
   m_descSetLayoutBind.addBinding(SceneBindings::eObjDescs, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
-                                 VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+                                 VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR
+                                     | VK_SHADER_STAGE_ANY_HIT_BIT_KHR);
   // 所有纹理采样器
-  m_descSetLayoutBind.addBinding(SceneBindings::eTextures, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nbTxt,
-                                 VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+  m_descSetLayoutBind.addBinding(SceneBindings::eTextures, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_maxTextures,
+                                 VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR);
+  // 纹理流式状态与mip feedback SSBO
+  m_descSetLayoutBind.addBinding(SceneBindings::eTexInfos, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+
+  // 运行时会变化的绑定：物体描述buffer扩容后重写，纹理数组只写入已存在的元素
+  m_descSetLayoutBind.setBindingFlags(SceneBindings::eObjDescs, VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT);
+  m_descSetLayoutBind.setBindingFlags(SceneBindings::eTextures,
+                                      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT);
 
   // 创建layout和pool
-  m_descSetLayout = m_descSetLayoutBind.createLayout(m_device);
-  m_descPool      = m_descSetLayoutBind.createPool(m_device, 1);
+  m_descSetLayout = m_descSetLayoutBind.createLayout(m_device, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+  m_descPool      = m_descSetLayoutBind.createPool(m_device, 1, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
   m_descSet       = nvvk::allocateDescriptorSet(m_device, m_descPool, m_descSetLayout);
 }
 
@@ -235,16 +277,33 @@ void HelloVulkan::updateDescriptorSet()
   VkDescriptorBufferInfo dbiSceneDesc{m_bObjDesc.buffer, 0, VK_WHOLE_SIZE};
   writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descSet, SceneBindings::eObjDescs, &dbiSceneDesc));
 
+  // 纹理流式状态
+  VkDescriptorBufferInfo dbiTexInfo{m_texStreamer.getInfoBuffer().buffer, 0, VK_WHOLE_SIZE};
+  writes.emplace_back(m_descSetLayoutBind.makeWrite(m_descSet, SceneBindings::eTexInfos, &dbiTexInfo));
+
+  // 写入描述符集
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
   // 纹理数组
+  updateTextureDescriptors(0, static_cast<uint32_t>(m_textures.size()));
+}
+
+//--------------------------------------------------------------------------------------------------
+// 写入纹理数组中 [first, first+count) 的描述符（binding为partially bound，未写入的元素不会被访问）
+void HelloVulkan::updateTextureDescriptors(uint32_t first, uint32_t count)
+{
+  count = std::min(count, m_maxTextures - std::min(first, m_maxTextures));
+  if(count == 0)
+    return;
+
   std::vector<VkDescriptorImageInfo> diit;
-  for(auto& texture : m_textures)
+  for(uint32_t i = first; i < first + count; i++)
   {
-    diit.emplace_back(texture.descriptor);
+    diit.emplace_back(m_textures[i].descriptor);
   }
-  writes.emplace_back(m_descSetLayoutBind.makeWriteArray(m_descSet, SceneBindings::eTextures, diit.data()));
-
-  // 写入描述符集
-  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+  VkWriteDescriptorSet write = m_descSetLayoutBind.makeWrite(m_descSet, SceneBindings::eTextures, diit.data(), first);
+  write.descriptorCount      = count;
+  vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
 }
 
 // --------------------------------------------------------------------------------------------------
@@ -268,12 +327,11 @@ void HelloVulkan::createGraphicsPipeline()
   vkCreatePipelineLayout(m_device, &createInfo, nullptr, &m_pipelineLayout);
 
   // 构造图形管线
-  std::vector<std::string>                paths = defaultSearchPaths;
   nvvk::GraphicsPipelineGeneratorCombined gpb(m_device, m_pipelineLayout, m_offscreenRenderPass);
   gpb.depthStencilState.depthTestEnable = true;
-  // 加载SPIR-V shader
-  gpb.addShader(nvh::loadFile("spv/vert_shader.vert.spv", true, paths, true), VK_SHADER_STAGE_VERTEX_BIT);
-  gpb.addShader(nvh::loadFile("spv/frag_shader.frag.spv", true, paths, true), VK_SHADER_STAGE_FRAGMENT_BIT);
+  // 加载嵌入的SPIR-V shader
+  gpb.addShader(spirv::load("vert_shader.vert.spv"), VK_SHADER_STAGE_VERTEX_BIT);
+  gpb.addShader(spirv::load("frag_shader.frag.spv"), VK_SHADER_STAGE_FRAGMENT_BIT);
   // 顶点输入描述
   gpb.addBindingDescription({0, sizeof(VertexObj)});
   gpb.addAttributeDescriptions({
@@ -283,7 +341,7 @@ void HelloVulkan::createGraphicsPipeline()
       {3, 0, VK_FORMAT_R32G32_SFLOAT, static_cast<uint32_t>(offsetof(VertexObj, texCoord))},
   });
 
-  m_graphicsPipeline = gpb.createPipeline();
+  m_graphicsPipeline = gpb.createPipeline(m_pipelineCache);
   m_debug.setObjectName(m_graphicsPipeline, "Graphics");
 }
 
@@ -296,31 +354,45 @@ void HelloVulkan::loadModel(ModelLoader& loader, glm::mat4 transform)
   // 将材质颜色从SRGB空间转换到线性空间
   for(auto& m : loader.m_materials)
   {
+    m_sceneTextured |= m.textureID >= 0;
     m.ambient  = glm::pow(m.ambient, glm::vec3(2.2f));
     m.diffuse  = glm::pow(m.diffuse, glm::vec3(2.2f));
     m.specular = glm::pow(m.specular, glm::vec3(2.2f));
   }
 
+  nvvk::CommandPool cmdBufGet(m_device, m_graphicsQueueIndex);
+  VkCommandBuffer   cmdBuf = cmdBufGet.createCommandBuffer();
+
+  // 纹理贴图（若有），解码时顺便生成alpha范围图，三角形分类不需要再读一次图片
+  // 不记录偏移，全部mesh复用第一个mesh的贴图，作为全局贴图
+  // todo: add global textures
+  auto                         txtOffset = 0;//static_cast<uint32_t>(m_textures.size());
+  std::vector<tex::AlphaRange> textureAlpha;
+  createTextureImages(cmdBuf, loader.m_textures, &textureAlpha);
+
+  // 按材质拆分时三角形会被重排，必须在计算哈希和上传索引之前
   ObjModel model;
-  model.nbIndices  = static_cast<uint32_t>(loader.m_indices.size());
-  model.nbVertices = static_cast<uint32_t>(loader.m_vertices.size());
+  model.alphaRanges  = materialAlphaRanges(loader, textureAlpha);
+  model.subsets      = buildSubsets(loader, m_splitByMaterial, model.alphaRanges);
+  model.nbIndices    = static_cast<uint32_t>(loader.m_indices.size());
+  model.nbVertices   = static_cast<uint32_t>(loader.m_vertices.size());
+  model.geometryHash = hashGeometry(loader);
+  classifyHitGroup(loader, model);
 
   // 在设备上创建并上传顶点、索引、材质等buffer
-  nvvk::CommandPool  cmdBufGet(m_device, m_graphicsQueueIndex);
-  VkCommandBuffer    cmdBuf          = cmdBufGet.createCommandBuffer();
   VkBufferUsageFlags flag            = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
   VkBufferUsageFlags rayTracingFlags =  // 用于光追加速结构构建
       flag | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-  model.vertexBuffer = m_alloc.createBuffer(cmdBuf, loader.m_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | rayTracingFlags);
-  model.indexBuffer = m_alloc.createBuffer(cmdBuf, loader.m_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | rayTracingFlags);
-  model.matColorBuffer = m_alloc.createBuffer(cmdBuf, loader.m_materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
-  model.matIndexBuffer = m_alloc.createBuffer(cmdBuf, loader.m_matIndx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
-
-  // 纹理贴图（若有），并记录偏移
-  // 不记录偏移，全部mesh复用第一个mesh的贴图，作为全局贴图
-  // todo: add global textures
-  auto txtOffset = 0;//static_cast<uint32_t>(m_textures.size());
-  createTextureImages(cmdBuf, loader.m_textures);
+  // 几何数据经由staging ring分块上传
+  model.vertexBuffer   = createDeviceBuffer(loader.m_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | rayTracingFlags);
+  model.indexBuffer    = createDeviceBuffer(loader.m_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | rayTracingFlags);
+  model.matColorBuffer = createDeviceBuffer(loader.m_materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
+  model.matIndexBuffer = createDeviceBuffer(loader.m_matIndx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
+  // 每个BLAS geometry的材质和起始三角形，命中时按 gl_GeometryIndexEXT 读取
+  std::vector<GeometryDesc> geometries = geometryDescs(model.subsets);
+  model.geometryBuffer = createDeviceBuffer(geometries, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
+  model.topologyHash   = hashTopology(loader, geometries);
+  m_stagingRing.flush();
   cmdBufGet.submitAndWait(cmdBuf);
 
   // 分配mesh和texture完毕
@@ -331,6 +403,7 @@ void HelloVulkan::loadModel(ModelLoader& loader, glm::mat4 transform)
   m_debug.setObjectName(model.indexBuffer.buffer, (std::string("index_" + objNb)));
   m_debug.setObjectName(model.matColorBuffer.buffer, (std::string("mat_" + objNb)));
   m_debug.setObjectName(model.matIndexBuffer.buffer, (std::string("matIdx_" + objNb)));
+  m_debug.setObjectName(model.geometryBuffer.buffer, (std::string("geom_" + objNb)));
 
   // 生成实例信息
   ObjInstance instance;
@@ -345,11 +418,373 @@ void HelloVulkan::loadModel(ModelLoader& loader, glm::mat4 transform)
   desc.indexAddress         = nvvk::getBufferDeviceAddress(m_device, model.indexBuffer.buffer);
   desc.materialAddress      = nvvk::getBufferDeviceAddress(m_device, model.matColorBuffer.buffer);
   desc.materialIndexAddress = nvvk::getBufferDeviceAddress(m_device, model.matIndexBuffer.buffer);
+  desc.geometryAddress      = nvvk::getBufferDeviceAddress(m_device, model.geometryBuffer.buffer);
 
   // 存储模型与描述
   m_objModel.emplace_back(model);
   m_objDesc.emplace_back(desc);
   m_Loader.emplace_back(loader);
+  m_sbtDirty = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 按模型用到的材质确定它的hit group和SBT记录数据（见 createRtSbt）：
+// - 有不设opaque的geometry（alpha测试或dissolve < 1，见 buildSubsets）：eHitTransparent，由any-hit丢弃命中
+// - 只有一个材质且自发光（最亮的emission通道超过 m_emissiveThreshold）：eHitEmissive，直接返回emission
+// - 其余：eHitOpaque
+// 一个实例只对应一条SBT记录，材质类别混合的模型取能正确渲染所有三角形的类别（透明优先，自发光要求单一材质）
+void HelloVulkan::classifyHitGroup(const ModelLoader& loader, ObjModel& model) const
+{
+  std::vector<bool> used(loader.m_materials.size(), false);
+  for(int32_t m : loader.m_matIndx)
+  {
+    // 材质索引-1按材质0处理（与逐三角形查找时一致），没有材质的mesh不标记
+    const size_t index = static_cast<size_t>(std::max(m, 0));
+    if(index < used.size())
+      used[index] = true;
+  }
+
+  model.hitGroup  = eHitOpaque;
+  model.hitRecord = HitRecord{glm::vec3(0.0f), -1};
+  uint32_t usedCount = 0;
+  for(size_t m = 0; m < used.size(); m++)
+  {
+    if(!used[m])
+      continue;
+    usedCount++;
+    model.hitRecord.materialIndex = static_cast<int>(m);
+  }
+  if(usedCount != 1)
+    model.hitRecord.materialIndex = -1;
+
+  if(std::any_of(model.subsets.begin(), model.subsets.end(), [](const MeshSubset& subset) { return !subset.opaque; }))
+  {
+    model.hitGroup = eHitTransparent;
+  }
+  else if(usedCount == 1)
+  {
+    const glm::vec3& emission = loader.m_materials[model.hitRecord.materialIndex].emission;
+    if(std::max({emission.x, emission.y, emission.z}) > m_emissiveThreshold)
+    {
+      model.hitGroup           = eHitEmissive;
+      model.hitRecord.emission = emission;
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// 把mesh的三角形划分为BLAS geometry
+// split: 按（三角形材质，alpha覆盖情况）稳定排序（索引和三角形材质索引一起重排），相同的连续三角形为一个geometry，
+//        命中着色器直接取geometry的材质，省去逐三角形的材质索引读取
+//        alpha纹理（alpha[material] 不为空）的三角形在host上按纹理坐标预先分类（tex::alphaCoverage）：
+//        完全不透明的设opaque走快速路径，完全透明的不放入BLAS，只有部分透明的调用any-hit；dissolve < 1 的三角形都调用any-hit
+// 不拆分，或三角形材质索引与三角形数不一致时，整个mesh为一个geometry，材质仍逐三角形查找，有任何需要any-hit的材质时不设opaque
+std::vector<HelloVulkan::MeshSubset> HelloVulkan::buildSubsets(ModelLoader& loader, bool split, const std::vector<tex::AlphaRange>& alpha)
+{
+  const auto              triCount = static_cast<uint32_t>(loader.m_indices.size() / 3);
+  std::vector<MeshSubset> subsets;
+  auto alphaTested = [&](size_t material) { return material < alpha.size() && !alpha[material].empty(); };
+  if(!split || triCount == 0 || loader.m_matIndx.size() != triCount)
+  {
+    bool opaque = true;
+    for(size_t m = 0; m < loader.m_materials.size(); m++)
+      opaque &= !alphaTested(m) && loader.m_materials[m].dissolve >= 1.0f;
+    subsets.push_back({0, triCount, -1, opaque});
+    return subsets;
+  }
+
+  // 材质索引-1按材质0处理（与逐三角形查找时一致）
+  auto materialOf = [&](uint32_t tri) { return std::max(loader.m_matIndx[tri], 0); };
+
+  const auto                      cutoff = static_cast<uint8_t>(std::ceil(ALPHA_CUTOFF * 255.0));
+  std::vector<tex::AlphaCoverage> coverage(triCount, tex::AlphaCoverage::eOpaque);
+  for(uint32_t t = 0; t < triCount; t++)
+  {
+    const auto material = static_cast<size_t>(materialOf(t));
+    if(material >= loader.m_materials.size())
+      continue;
+    if(alphaTested(material))
+    {
+      float uv[6];
+      for(uint32_t k = 0; k < 3; k++)
+      {
+        const VertexObj& v = loader.m_vertices[loader.m_indices[3 * t + k]];
+        uv[2 * k + 0]      = v.texCoord.x;
+        uv[2 * k + 1]      = v.texCoord.y;
+      }
+      coverage[t] = tex::alphaCoverage(alpha[material], uv, cutoff);
+    }
+    if(coverage[t] == tex::AlphaCoverage::eOpaque && loader.m_materials[material].dissolve < 1.0f)
+      coverage[t] = tex::AlphaCoverage::eMixed;
+  }
+
+  std::vector<uint32_t> order(triCount);
+  std::iota(order.begin(), order.end(), 0u);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return std::make_pair(materialOf(a), coverage[a]) < std::make_pair(materialOf(b), coverage[b]);
+  });
+
+  std::vector<uint32_t>           indices(loader.m_indices.size());
+  std::vector<int32_t>            matIndx(triCount);
+  std::vector<tex::AlphaCoverage> sortedCoverage(triCount);
+  for(uint32_t t = 0; t < triCount; t++)
+  {
+    const uint32_t src = order[t];
+    indices[3 * t + 0] = loader.m_indices[3 * src + 0];
+    indices[3 * t + 1] = loader.m_indices[3 * src + 1];
+    indices[3 * t + 2] = loader.m_indices[3 * src + 2];
+    matIndx[t]         = materialOf(src);
+    sortedCoverage[t]  = coverage[src];
+  }
+  loader.m_indices.swap(indices);
+  loader.m_matIndx.swap(matIndx);
+
+  for(uint32_t t = 0; t < triCount; t++)
+  {
+    // 完全透明的三角形留在索引buffer中（光栅化仍会绘制），只是不属于任何geometry
+    if(sortedCoverage[t] == tex::AlphaCoverage::eTransparent)
+      continue;
+    const int  material = loader.m_matIndx[t];
+    const bool opaque   = sortedCoverage[t] == tex::AlphaCoverage::eOpaque;
+    if(subsets.empty() || subsets.back().material != material || subsets.back().opaque != opaque
+       || subsets.back().firstPrimitive + subsets.back().primitiveCount != t)
+      subsets.push_back({t, 0, material, opaque});
+    subsets.back().primitiveCount++;
+  }
+  // 所有三角形都完全透明：BLAS至少需要一个geometry，全部交给any-hit
+  if(subsets.empty())
+    subsets.push_back({0, triCount, -1, false});
+  return subsets;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 每个材质的纹理alpha范围图，纹理不透明、不是颜色贴图或读取失败时为空（不做alpha测试）
+// textureAlpha：createTextureImages 解码 loader.m_textures 时生成的范围图，按纹理索引
+std::vector<tex::AlphaRange> HelloVulkan::materialAlphaRanges(const ModelLoader& loader, const std::vector<tex::AlphaRange>& textureAlpha)
+{
+  std::vector<tex::AlphaRange> ranges(loader.m_materials.size());
+  for(size_t m = 0; m < loader.m_materials.size(); m++)
+  {
+    const int id = loader.m_materials[m].textureID;
+    if(id < 0 || id >= static_cast<int>(textureAlpha.size()) || textureAlpha[id].opaque())
+      continue;
+    ranges[m] = textureAlpha[id];
+  }
+  return ranges;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 每个BLAS geometry的 GeometryDesc（geometryBuffer 的内容）
+std::vector<GeometryDesc> HelloVulkan::geometryDescs(const std::vector<MeshSubset>& subsets)
+{
+  std::vector<GeometryDesc> geometries;
+  geometries.reserve(subsets.size());
+  for(const auto& subset : subsets)
+    geometries.push_back({subset.material, subset.firstPrimitive});
+  return geometries;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 除顶点外显存中的几何内容（索引、三角形材质索引、GeometryDesc）的哈希，updateBlas 用来判断是否需要重新上传
+uint64_t HelloVulkan::hashTopology(const ModelLoader& loader, const std::vector<GeometryDesc>& geometries)
+{
+  uint64_t h = contentHash(loader.m_indices.data(), loader.m_indices.size() * sizeof(uint32_t));
+  h          = contentHash(loader.m_matIndx.data(), loader.m_matIndx.size() * sizeof(int32_t), h);
+  return contentHash(geometries.data(), geometries.size() * sizeof(GeometryDesc), h);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 顶点和索引内容的哈希，作为BLAS磁盘缓存键的一部分
+uint64_t HelloVulkan::hashGeometry(const ModelLoader& loader)
+{
+  uint64_t h = contentHash(loader.m_vertices.data(), loader.m_vertices.size() * sizeof(VertexObj));
+  return contentHash(loader.m_indices.data(), loader.m_indices.size() * sizeof(uint32_t), h);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 运行时追加模型（createBVH之后，如Hydra中mesh分批到达）
+// 描述符数组是bindless的，只需写入新纹理的描述符、扩容物体描述buffer，只构建新模型的BLAS并重建TLAS，管线不变
+// 返回模型索引
+uint32_t HelloVulkan::addModel(ModelLoader& loader, glm::mat4 transform)
+{
+  auto firstTexture = static_cast<uint32_t>(m_textures.size());
+  auto objIndex     = static_cast<uint32_t>(m_objModel.size());
+  loadModel(loader, transform);
+
+  if(m_textures.size() > m_maxTextures)
+  {
+    LOGE("Too many textures (%zu), only the first %u are bound\n", m_textures.size(), m_maxTextures);
+  }
+  updateTextureDescriptors(firstTexture, static_cast<uint32_t>(m_textures.size()) - firstTexture);
+
+  nvvk::CommandPool cmdGen(m_device, m_graphicsQueueIndex);
+  VkCommandBuffer   cmdBuf = cmdGen.createCommandBuffer();
+  updateObjDescriptionBuffer(cmdBuf);
+  cmdGen.submitAndWait(cmdBuf);
+  m_alloc.finalizeAndReleaseStaging();
+
+  // 新BLAS追加在已有BLAS之后，序号与模型序号一致；已有BLAS（含压缩和磁盘缓存的结果）保持不变
+  if(m_blasBuilder.size() == objIndex && m_blas.size() == objIndex)
+  {
+    m_blas.push_back(objectToVkGeometryKHR(m_objModel[objIndex], &m_Loader[objIndex]));
+    m_blasBuilder.build({m_blas.back()});
+    m_tlasRebuild = true;
+  }
+  else
+  {
+    rebuildAccelerationStructures();
+  }
+  return objIndex;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 运行时删除模型及其所有实例，后面的模型索引前移
+// 纹理是全场景共享的（见loadModel中的txtOffset），不随模型删除
+void HelloVulkan::removeModel(uint32_t objIndex)
+{
+  if(objIndex >= m_objModel.size())
+    return;
+
+  // 上一帧可能仍在使用这些buffer
+  vkQueueWaitIdle(m_queue);
+
+  ObjModel& model = m_objModel[objIndex];
+  m_alloc.destroy(model.vertexBuffer);
+  m_alloc.destroy(model.indexBuffer);
+  m_alloc.destroy(model.matColorBuffer);
+  m_alloc.destroy(model.matIndexBuffer);
+  m_alloc.destroy(model.geometryBuffer);
+
+  m_objModel.erase(m_objModel.begin() + objIndex);
+  m_objDesc.erase(m_objDesc.begin() + objIndex);
+  m_sbtDirty = true;
+  if(objIndex < m_Loader.size())
+    m_Loader.erase(m_Loader.begin() + objIndex);
+
+  // 删除引用该模型的实例，并修正后续模型的索引
+  m_instances.erase(std::remove_if(m_instances.begin(), m_instances.end(),
+                                   [objIndex](const ObjInstance& inst) { return inst.objIndex == objIndex; }),
+                    m_instances.end());
+  for(auto& inst : m_instances)
+  {
+    if(inst.objIndex > objIndex)
+      inst.objIndex--;
+  }
+
+  nvvk::CommandPool cmdGen(m_device, m_graphicsQueueIndex);
+  VkCommandBuffer   cmdBuf = cmdGen.createCommandBuffer();
+  updateObjDescriptionBuffer(cmdBuf);
+  cmdGen.submitAndWait(cmdBuf);
+  m_alloc.finalizeAndReleaseStaging();
+
+  rebuildAccelerationStructures();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 删除模型后（后面的模型序号前移）立即重建所有BLAS，TLAS在本帧追踪前的 flushTlas 中重建
+void HelloVulkan::rebuildAccelerationStructures()
+{
+  m_blasBuilder.clear();
+  m_blas.clear();
+  createBottomLevelAS();
+  m_tlasRebuild = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 实例增删后只重建TLAS（BLAS由m_blasBuilder持有，不受影响），并把新的TLAS写入光追描述符集
+void HelloVulkan::rebuildTopLevelAS()
+{
+  m_tlas.clear();
+  m_tlasDirty.clear();
+  m_tlasRefit   = false;
+  m_tlasRebuild = false;
+  createTopLevelAS();
+
+  VkAccelerationStructureKHR tlas = m_tlasBuilder.getAccelerationStructure();
+  VkWriteDescriptorSetAccelerationStructureKHR descASInfo{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR};
+  descASInfo.accelerationStructureCount = 1;
+  descASInfo.pAccelerationStructures    = &tlas;
+  VkWriteDescriptorSet wds = m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eTlas, &descASInfo);
+  vkUpdateDescriptorSets(m_device, 1, &wds, 0, nullptr);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 为已有模型追加实例：与其他实例共享顶点buffer和BLAS，只在TLAS中多若干项（点实例化的每个变换一项）
+// 新实例连续存放，createBVH之后调用时标记TLAS需要重建（本帧追踪前重建一次）；返回第一个实例的索引
+uint32_t HelloVulkan::addInstances(uint32_t objIndex, const std::vector<glm::mat4>& transforms)
+{
+  auto first = static_cast<uint32_t>(m_instances.size());
+  m_instances.reserve(m_instances.size() + transforms.size());
+  for(const glm::mat4& transform : transforms)
+  {
+    ObjInstance instance;
+    instance.transform = transform;
+    instance.objIndex  = objIndex;
+    m_instances.push_back(instance);
+  }
+
+  if(m_tlasBuilder.getAccelerationStructure() != VK_NULL_HANDLE && !transforms.empty())
+    m_tlasRebuild = true;
+  return first;
+}
+
+uint32_t HelloVulkan::addInstance(uint32_t objIndex, const glm::mat4& transform)
+{
+  return addInstances(objIndex, {transform});
+}
+
+// 以下setter只修改实例数据并把实例槽位记入dirty集合，TLAS在 flushTlas 中统一更新一次
+// createBVH之前调用时只修改m_instances，createTopLevelAS会用到
+void HelloVulkan::setInstanceTransform(uint32_t instIndex, const glm::mat4& transform)
+{
+  m_instances[instIndex].transform = transform;
+  if(instIndex < m_tlas.size())
+  {
+    m_tlas[instIndex].transform = nvvk::toTransformMatrixKHR(transform);
+    m_tlasDirty.push_back(instIndex);
+  }
+}
+
+// 让实例改为引用另一个模型（如共享几何的mesh形变后与另一份几何相同）
+void HelloVulkan::setInstanceObject(uint32_t instIndex, uint32_t objIndex)
+{
+  m_instances[instIndex].objIndex = objIndex;
+  if(instIndex < m_tlas.size())
+  {
+    setInstanceObjectData(m_tlas[instIndex], objIndex);
+    m_tlasDirty.push_back(instIndex);
+  }
+}
+
+// 隐藏/显示实例：实例数不变，TLAS只需更新
+void HelloVulkan::setInstanceVisible(uint32_t instIndex, bool visible)
+{
+  m_instances[instIndex].visible = visible;
+  if(instIndex < m_tlas.size())
+  {
+    m_tlas[instIndex].mask = visible ? 0xFF : 0x00;
+    m_tlasDirty.push_back(instIndex);
+  }
+}
+
+// 每帧追踪前调用一次（RayTraceApp::render），把本帧所有的实例修改合并为一次TLAS构建：
+// - 有实例增删时重建TLAS
+// - 否则只上传dirty集合中的实例，由计算着色器写入显存后refit一次
+void HelloVulkan::flushTlas()
+{
+  if(m_tlasRebuild)
+  {
+    rebuildTopLevelAS();
+    resetAccumulation();
+    return;
+  }
+  if(m_tlasDirty.empty() && !m_tlasRefit && !m_tlasBuilder.hasPendingAnimation())
+    return;
+  // 场景变了，之前累积的样本作废
+  resetAccumulation();
+  m_tlasBuilder.update(m_tlas, m_tlasDirty);
+  m_tlasDirty.clear();
+  m_tlasRefit = false;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -369,25 +804,88 @@ void HelloVulkan::createObjDescriptionBuffer()
   nvvk::CommandPool cmdGen(m_device, m_graphicsQueueIndex);
 
   auto cmdBuf = cmdGen.createCommandBuffer();
-  m_bObjDesc  = m_alloc.createBuffer(cmdBuf, m_objDesc, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  updateObjDescriptionBuffer(cmdBuf);
   cmdGen.submitAndWait(cmdBuf);
   m_alloc.finalizeAndReleaseStaging();
-  m_debug.setObjectName(m_bObjDesc.buffer, "ObjDescs");
+}
+
+//--------------------------------------------------------------------------------------------------
+// 把 m_objDesc 上传到设备，容量不足时按2倍扩容
+// buffer重新分配后，若描述符集已创建则重写 eObjDescs（binding为update-after-bind）
+void HelloVulkan::updateObjDescriptionBuffer(const VkCommandBuffer& cmdBuf)
+{
+  auto count = static_cast<uint32_t>(m_objDesc.size());
+  if(m_bObjDesc.buffer == VK_NULL_HANDLE || count > m_objDescCapacity)
+  {
+    uint32_t capacity = std::max(m_objDescCapacity, 16u);
+    while(capacity < count)
+      capacity *= 2;
+
+    m_alloc.destroy(m_bObjDesc);
+    m_objDescCapacity = capacity;
+    m_bObjDesc = m_alloc.createBuffer(capacity * sizeof(ObjDesc), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_debug.setObjectName(m_bObjDesc.buffer, "ObjDescs");
+
+    if(m_descSet != VK_NULL_HANDLE)
+    {
+      VkDescriptorBufferInfo dbiSceneDesc{m_bObjDesc.buffer, 0, VK_WHOLE_SIZE};
+      VkWriteDescriptorSet   wds = m_descSetLayoutBind.makeWrite(m_descSet, SceneBindings::eObjDescs, &dbiSceneDesc);
+      vkUpdateDescriptorSets(m_device, 1, &wds, 0, nullptr);
+    }
+  }
+
+  if(count > 0)
+    m_alloc.getStaging()->cmdToBuffer(cmdBuf, m_bObjDesc.buffer, 0, count * sizeof(ObjDesc), m_objDesc.data());
+}
+
+//--------------------------------------------------------------------------------------------------
+// 创建纹理流式状态buffer（每个纹理一个TextureInfo），需在所有模型加载之后调用
+void HelloVulkan::createTextureInfoBuffer()
+{
+  m_texStreamer.createInfoBuffer(m_maxTextures);
+  m_debug.setObjectName(m_texStreamer.getInfoBuffer().buffer, "TextureInfos");
+}
+
+//--------------------------------------------------------------------------------------------------
+// 每帧提交之后调用：根据feedback流式加载/淘汰纹理，并就地更新纹理数组中变化的描述符
+// submitFrame 会等待队列空闲，此时更新描述符是安全的
+void HelloVulkan::updateTextureStreaming()
+{
+  if(!m_texStreamer.isEnabled())
+    return;
+
+  // 驻留的mip改变后纹理的样子也变了，重新累积
+  for(uint32_t index : m_texStreamer.update(m_textures))
+  {
+    updateTextureDescriptors(index, 1);
+    resetAccumulation();
+  }
 }
 
 //--------------------------------------------------------------------------------------------------
 // 创建所有纹理贴图和采样器，并上传到GPU
 // cmdBuf: 用于资源上传的命令缓冲
 // textures: 纹理文件名数组
-void HelloVulkan::createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures)
+// alphaRanges: 不为空时输出每个纹理的alpha范围图（只有颜色贴图，用解码出的原始像素生成，见 buildSubsets）
+void HelloVulkan::createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures, std::vector<tex::AlphaRange>* alphaRanges)
 {
+  if(alphaRanges)
+    alphaRanges->assign(textures.size(), {});
+
   VkSamplerCreateInfo samplerCreateInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
   samplerCreateInfo.minFilter  = VK_FILTER_LINEAR;
   samplerCreateInfo.magFilter  = VK_FILTER_LINEAR;
   samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   samplerCreateInfo.maxLod     = FLT_MAX;
 
-  VkFormat format = VK_FORMAT_R8G8B8A8_SRGB;
+  // LOD偏移：预览渲染时调大，采样更小的mip（同样作用于光追中的textureLod）
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+  float maxBias                = properties.limits.maxSamplerLodBias;
+  samplerCreateInfo.mipLodBias = std::clamp(m_textureOptions.lodBias, -maxBias, maxBias);
+
+  VkFormat format = tex::uncompressedFormat(TextureRole::eAlbedo);
 
   // 若没有任何纹理，为了兼容pipeline，创建一个dummy白色纹理
   if(textures.empty() && m_textures.empty())
@@ -405,48 +903,130 @@ void HelloVulkan::createTextureImages(const VkCommandBuffer& cmdBuf, const std::
 
     nvvk::cmdBarrierImageLayout(cmdBuf, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     m_textures.push_back(texture);
+    m_texStreamer.addResident(1, 1);
   }
   else
   {
     // 批量加载所有图片
-    for(const auto& texture : textures)
+    for(size_t i = 0; i < textures.size(); i++)
     {
-      std::stringstream o;
-      int               texWidth, texHeight, texChannels;
+      const std::string& texture = textures[i];
+      std::stringstream  o;
+      int                texWidth, texHeight, texChannels;
       o << "media/textures/" << texture;
-      std::string txtFile = nvh::findFile(o.str(), defaultSearchPaths, true);
-
-      stbi_uc* stbi_pixels = stbi_load(txtFile.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-
-      std::array<stbi_uc, 4> color{255u, 0u, 255u, 255u};
+      std::string      txtFile = nvh::findFile(o.str(), defaultSearchPaths, true);
+      TextureRole      role    = tex::guessRole(texture);
+      tex::AlphaRange* alpha   = alphaRanges && role == TextureRole::eAlbedo ? &(*alphaRanges)[i] : nullptr;
 
-      stbi_uc* pixels = stbi_pixels;
-      // 兜底：加载失败时用紫色
-      if(!stbi_pixels)
+      // 流式加载：只上传mip尾部，更精细的mip按feedback在之后的帧中加载
+      if(m_texStreamer.isEnabled())
       {
-        texWidth = texHeight = 1;
-        texChannels          = 4;
-        pixels               = reinterpret_cast<stbi_uc*>(color.data());
+        TextureOptions options = m_textureOptions;
+        options.compress       = options.compress && isFormatSampleable(VK_FORMAT_BC7_SRGB_BLOCK);
+        m_textures.push_back(m_texStreamer.addTexture(cmdBuf, txtFile, role, options, samplerCreateInfo, alpha, m_alphaRangeResolution));
+        continue;
       }
 
-      VkDeviceSize bufferSize      = static_cast<uint64_t>(texWidth) * texHeight * sizeof(uint8_t) * 4;
-      auto         imgSize         = VkExtent2D{(uint32_t)texWidth, (uint32_t)texHeight};
-      auto         imageCreateInfo = nvvk::makeImage2DCreateInfo(imgSize, format, VK_IMAGE_USAGE_SAMPLED_BIT, true);
-
+      // 预压缩的DDS容器：直接上传所有mip
+      TextureData data;
+      if(txtFile.size() > 4 && txtFile.compare(txtFile.size() - 4, 4, ".dds") == 0)
       {
-        nvvk::Image image = m_alloc.createImage(cmdBuf, bufferSize, pixels, imageCreateInfo);
-        nvvk::cmdGenerateMipmaps(cmdBuf, image.image, format, imgSize, imageCreateInfo.mipLevels);
-        VkImageViewCreateInfo ivInfo  = nvvk::makeImageViewCreateInfo(image.image, imageCreateInfo);
-        nvvk::Texture         texture = m_alloc.createTexture(image, ivInfo, samplerCreateInfo);
+        if(!tex::loadDDS(txtFile, role, data) || !isFormatSampleable(data.format))
+        {
+          LOGW("Failed to load compressed texture %s\n", txtFile.c_str());
+          data = {};
+        }
+        else if(alpha)
+          tex::formatAlphaRange(data.format, *alpha);
+        tex::dropMipsAbove(data, m_textureOptions.maxResolution);
+      }
 
-        m_textures.push_back(texture);
+      if(data.empty())
+      {
+        stbi_uc* stbi_pixels = stbi_load(txtFile.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+
+        // 兜底：加载失败时用紫色
+        std::vector<uint8_t> pixels{255u, 0u, 255u, 255u};
+        uint32_t             width = 1, height = 1;
+        const bool           decoded = stbi_pixels != nullptr;
+        if(decoded)
+        {
+          width  = texWidth;
+          height = texHeight;
+          pixels.assign(stbi_pixels, stbi_pixels + size_t(width) * height * 4);
+          if(alpha)
+            tex::buildAlphaRange(stbi_pixels, width, height, m_alphaRangeResolution, *alpha);
+          stbi_image_free(stbi_pixels);
+        }
+
+        // 分辨率上限：解码后立即缩小，之后的mip生成和上传都只处理缩小后的图像
+        bool srgb = role == TextureRole::eAlbedo;
+        tex::downsampleToFit(pixels, width, height, m_textureOptions.maxResolution, srgb, m_textureOptions.threads);
+
+        // 可选：CPU上生成mip链并编码为BC格式（压缩格式不能用blit生成mip）
+        VkFormat bcFormat = tex::selectCompressedFormat(role, tex::hasAlpha(pixels.data(), width, height),
+                                                        m_textureOptions.preferBC7);
+        bool     compress = m_textureOptions.compress && decoded && isFormatSampleable(bcFormat);
+        if(compress || m_textureOptions.cpuMips)
+        {
+          tex::buildMipChain(pixels.data(), width, height, srgb, data.mips, m_textureOptions.threads);
+          data.format = tex::uncompressedFormat(role);
+          if(compress)
+            tex::compress(data, bcFormat);
+        }
+        else
+        {
+          VkFormat     format          = tex::uncompressedFormat(role);
+          VkDeviceSize bufferSize      = static_cast<uint64_t>(width) * height * sizeof(uint8_t) * 4;
+          auto         imgSize         = VkExtent2D{width, height};
+          auto         imageCreateInfo = nvvk::makeImage2DCreateInfo(imgSize, format, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+
+          // mip 0 经 staging ring 上传，staging 内存峰值受预算约束；其余各级由GPU生成
+          // 上传可能跨越多个段，所以屏障和mip生成都录制在上传之后的 cmd() 上
+          nvvk::Image             image = m_alloc.createImage(imageCreateInfo);
+          VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, imageCreateInfo.mipLevels, 0, 1};
+          nvvk::cmdBarrierImageLayout(m_stagingRing.cmd(), image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+          m_stagingRing.uploadImage(image.image, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1}, {width, height, 1}, format,
+                                    pixels.data(), bufferSize);
+          nvvk::cmdGenerateMipmaps(m_stagingRing.cmd(), image.image, format, imgSize, imageCreateInfo.mipLevels);
+          VkImageViewCreateInfo ivInfo  = nvvk::makeImageViewCreateInfo(image.image, imageCreateInfo);
+          nvvk::Texture         texture = m_alloc.createTexture(image, ivInfo, samplerCreateInfo);
+
+          m_textures.push_back(texture);
+          m_texStreamer.addResident(width, height);
+        }
       }
 
-      stbi_image_free(stbi_pixels);
+      if(!data.empty())
+      {
+        m_textures.push_back(createTextureFromData(cmdBuf, data, samplerCreateInfo));
+        m_texStreamer.addResident(data.width(), data.height());
+      }
     }
   }
 }
 
+//--------------------------------------------------------------------------------------------------
+// 用CPU端准备好的数据（含全部mip，可为BC压缩格式）创建纹理
+// 每层mip通过staging直接拷贝到image，最后转换为shader只读布局（BC格式不能用blit生成mip）
+nvvk::Texture HelloVulkan::createTextureFromData(const VkCommandBuffer&     cmdBuf,
+                                                 const TextureData&         data,
+                                                 const VkSamplerCreateInfo& samplerCreateInfo)
+{
+  return TextureStreamer::createTexture(m_alloc, cmdBuf, data.format, data.mips.data(),
+                                        static_cast<uint32_t>(data.mips.size()), samplerCreateInfo, &m_stagingRing);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 查询设备是否支持以该格式采样（BC格式依赖 textureCompressionBC 特性）
+bool HelloVulkan::isFormatSampleable(VkFormat format)
+{
+  VkFormatProperties props;
+  vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &props);
+  return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
 //--------------------------------------------------------------------------------------------------
 // 释放销毁所有分配的资源，包括管线、buffer、图片、加速结构等
 // headless:检查资源有效性，仅销毁已创建的资源。
@@ -467,12 +1047,15 @@ void HelloVulkan::destroyResources()
     m_alloc.destroy(m.indexBuffer);
     m_alloc.destroy(m.matColorBuffer);
     m_alloc.destroy(m.matIndexBuffer);
+    m_alloc.destroy(m.geometryBuffer);
   }
 
   for(auto& t : m_textures)
   {
     m_alloc.destroy(t);
   }
+  m_texStreamer.deinit();
+  m_stagingRing.deinit();
 
 #if ENABLE_GL_VK_CONVERSION
   m_rtOutputGL.destroy(m_allocGL);
@@ -486,9 +1069,28 @@ void HelloVulkan::destroyResources()
   vkDestroyFramebuffer(m_device, m_offscreenFramebuffer, nullptr);
 
   // #VKRay 光线追踪相关
-  m_rtBuilder.destroy();
-  m_sbtWrapper.destroy();
-  vkDestroyPipeline(m_device, m_rtPipeline, nullptr);
+  m_tlasBuilder.deinit();
+  m_blasBuilder.deinit();
+  vkDestroyQueryPool(m_device, m_traceQueryPool, nullptr);
+  m_alloc.destroy(m_accumBuffer);
+  if(m_accumStatsMapped)
+    m_alloc.unmap(m_accumStats);
+  m_alloc.destroy(m_accumStats);
+  m_alloc.destroy(m_adaptiveTiles);
+  vkDestroyPipeline(m_device, m_adaptivePipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_adaptivePipelineLayout, nullptr);
+  for(auto& [key, variant] : m_rtVariants)
+  {
+    variant.sbt->destroy();
+    vkDestroyPipeline(m_device, variant.pipeline, nullptr);
+  }
+  m_rtVariants.clear();
+  for(auto& stage : m_rtStages)
+    vkDestroyShaderModule(m_device, stage.module, nullptr);
+  m_rtStages.clear();
+  for(VkShaderModule module : m_rtPathModules)
+    vkDestroyShaderModule(m_device, module, nullptr);
+  m_rtPathModules.clear();
   vkDestroyPipelineLayout(m_device, m_rtPipelineLayout, nullptr);
   vkDestroyDescriptorPool(m_device, m_rtDescPool, nullptr);
   vkDestroyDescriptorSetLayout(m_device, m_rtDescSetLayout, nullptr);
@@ -520,6 +1122,8 @@ void HelloVulkan::rasterize(const VkCommandBuffer& cmdBuf)
   // 遍历所有实例，分别绘制
   for(const HelloVulkan::ObjInstance& inst : m_instances)
   {
+    if(!inst.visible)
+      continue;
     auto& model            = m_objModel[inst.objIndex];
     m_pcRaster.objIndex    = inst.objIndex;   // 当前物体索引，传给shader
     m_pcRaster.modelMatrix = inst.transform;  // 当前实例变换矩阵
@@ -623,6 +1227,9 @@ void HelloVulkan::createOffscreenRender()
   info.height          = m_size.height;
   info.layers          = 1;
   vkCreateFramebuffer(m_device, &info, nullptr, &m_offscreenFramebuffer);
+
+  // 累积buffer与输出图像同尺寸
+  createAccumulationBuffer();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -636,23 +1243,47 @@ void HelloVulkan::initRayTracing()
   prop2.pNext = &m_rtProperties;
   vkGetPhysicalDeviceProperties2(m_physicalDevice, &prop2);
 
-  // 初始化BLAS/TLAS构建器
-  m_rtBuilder.setup(m_device, &m_alloc, m_graphicsQueueIndex);
-  // 初始化SBT封装器
-  m_sbtWrapper.setup(m_device, m_graphicsQueueIndex, &m_alloc, m_rtProperties);
+  // 初始化TLAS构建器（实例数组常驻显存）；BLAS由 m_blasBuilder 构建（按静态/可变形选择标志，静态BLAS压缩）
+  m_tlasBuilder.init(m_device, m_physicalDevice, m_graphicsQueueIndex, &m_alloc, m_pipelineCache);
+  m_blasBuilder.init(m_device, m_physicalDevice, m_graphicsQueueIndex, &m_alloc);
+  m_blasBuilder.setCompaction(m_blasCompaction);
+  m_blasBuilder.setHostBuild(m_blasHostBuild);
+  m_blasBuilder.setCacheDirectory(m_asCacheDirectory);
+
+  // 光追耗时统计：traceRays前后各写一个时间戳
+  VkQueryPoolCreateInfo queryInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  queryInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  queryInfo.queryCount = 2;
+  vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_traceQueryPool);
+  m_timestampPeriod = prop2.properties.limits.timestampPeriod;
+
+  // 自适应采样：由各tile的误差生成下一帧的采样数，只用push constant和buffer地址
+  VkPushConstantRange        pushConstant{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantAdaptive)};
+  VkPipelineLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges    = &pushConstant;
+  vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_adaptivePipelineLayout);
+
+  VkComputePipelineCreateInfo pipelineInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  pipelineInfo.layout = m_adaptivePipelineLayout;
+  pipelineInfo.stage  = nvvk::createShaderStageInfo(m_device, spirv::load("adaptive_sampling.comp.spv"), VK_SHADER_STAGE_COMPUTE_BIT);
+  vkCreateComputePipelines(m_device, m_pipelineCache, 1, &pipelineInfo, nullptr, &m_adaptivePipeline);
+  vkDestroyShaderModule(m_device, pipelineInfo.stage.module, nullptr);
 }
 
 //--------------------------------------------------------------------------------------------------
 // 将一个OBJ模型转为Vulkan光追BLAS所需的Geometry结构
-// 返回：nvvk::RaytracingBuilderKHR::BlasInput
-auto HelloVulkan::objectToVkGeometryKHR(const ObjModel& model)
+// - 每个 MeshSubset 一个geometry，共用顶点和索引buffer，由构建范围的 primitiveOffset 选择各自的三角形
+// - opaque 标志按geometry设置；geometry的标志和三角形范围也写入磁盘缓存键（BLAS中记录了geometry标志，
+//   完全透明的三角形不在任何范围内，只有纹理alpha改变时索引buffer不变）
+// loader: 模型在host上的顶点和索引，给出时同时生成host地址版本的geometry，用于host构建
+// 返回：BlasInput，用途（静态/可变形）取自 model.usage
+BlasInput HelloVulkan::objectToVkGeometryKHR(const ObjModel& model, const ModelLoader* loader)
 {
   // 获取顶点和索引buffer的设备地址
   VkDeviceAddress vertexAddress = nvvk::getBufferDeviceAddress(m_device, model.vertexBuffer.buffer);
   VkDeviceAddress indexAddress  = nvvk::getBufferDeviceAddress(m_device, model.indexBuffer.buffer);
 
-  uint32_t maxPrimitiveCount = model.nbIndices / 3;
-
   // 设置三角形数据（顶点格式、地址、步长、索引类型等）
   VkAccelerationStructureGeometryTrianglesDataKHR triangles{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR};
   triangles.vertexFormat             = VK_FORMAT_R32G32B32_SFLOAT;  // 顶点为vec3
@@ -662,22 +1293,38 @@ auto HelloVulkan::objectToVkGeometryKHR(const ObjModel& model)
   triangles.indexData.deviceAddress  = indexAddress;
   triangles.maxVertex                = model.nbVertices - 1;
 
-  // 设置几何体结构体，描述为三角形且为opaque类型
-  VkAccelerationStructureGeometryKHR asGeom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
-  asGeom.geometryType       = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
-  asGeom.flags              = VK_GEOMETRY_OPAQUE_BIT_KHR;
-  asGeom.geometry.triangles = triangles;
-
-  // BLAS构建范围
-  VkAccelerationStructureBuildRangeInfoKHR offset;
-  offset.firstVertex     = 0;
-  offset.primitiveCount  = maxPrimitiveCount;
-  offset.primitiveOffset = 0;
-  offset.transformOffset = 0;
-
-  nvvk::RaytracingBuilderKHR::BlasInput input;
-  input.asGeometry.emplace_back(asGeom);
-  input.asBuildOffsetInfo.emplace_back(offset);
+  BlasInput             input;
+  std::vector<uint32_t> geometryKey;
+  for(const auto& subset : model.subsets)
+  {
+    // 设置几何体结构体，描述为三角形，不透明的geometry跳过any-hit
+    VkAccelerationStructureGeometryKHR asGeom{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+    asGeom.geometryType       = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+    asGeom.flags              = subset.opaque ? VK_GEOMETRY_OPAQUE_BIT_KHR : 0;
+    asGeom.geometry.triangles = triangles;
+
+    // BLAS构建范围，primitiveOffset 是索引buffer中的字节偏移
+    VkAccelerationStructureBuildRangeInfoKHR offset;
+    offset.firstVertex     = 0;
+    offset.primitiveCount  = subset.primitiveCount;
+    offset.primitiveOffset = subset.firstPrimitive * 3 * sizeof(uint32_t);
+    offset.transformOffset = 0;
+
+    input.asGeometry.emplace_back(asGeom);
+    input.asBuildOffsetInfo.emplace_back(offset);
+    geometryKey.insert(geometryKey.end(), {asGeom.flags, subset.firstPrimitive, subset.primitiveCount});
+
+    if(loader)
+    {
+      asGeom.geometry.triangles.vertexData.hostAddress = loader->m_vertices.data();
+      asGeom.geometry.triangles.indexData.hostAddress  = loader->m_indices.data();
+      input.hostGeometry.emplace_back(asGeom);
+    }
+  }
+  input.usage        = model.usage;
+  input.geometryHash = model.geometryHash == 0 ?
+                           0 :
+                           contentHash(geometryKey.data(), geometryKey.size() * sizeof(uint32_t), model.geometryHash);
 
   return input;
 }
@@ -685,19 +1332,20 @@ auto HelloVulkan::objectToVkGeometryKHR(const ObjModel& model)
 //--------------------------------------------------------------------------------------------------
 // 创建所有物体的BLAS（底层加速结构）
 // - 每个ObjModel创建一个BLAS
+// - 静态模型：PREFER_FAST_TRACE + 压缩；可变形模型：PREFER_FAST_BUILD + ALLOW_UPDATE
 void HelloVulkan::createBottomLevelAS()
 {
   // 预分配空间
   m_blas.reserve(m_objModel.size());
   // 遍历每个模型，生成BLAS输入
-  for(const auto& obj : m_objModel)
+  // host上的顶点和索引（m_Loader）在构建期间不变，可以用于host构建
+  for(size_t i = 0; i < m_objModel.size(); i++)
   {
-    auto blas = objectToVkGeometryKHR(obj);
+    auto blas = objectToVkGeometryKHR(m_objModel[i], i < m_Loader.size() ? &m_Loader[i] : nullptr);
     m_blas.push_back(blas);
   }
-  // 构建所有BLAS，允许更新和快速构建
-  m_rtBuilder.buildBlas(m_blas, VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR
-                                    | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR);
+  // 构建所有BLAS，日志中输出压缩节省的内存
+  m_blasBuilder.build(m_blas);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -708,18 +1356,30 @@ void HelloVulkan::createTopLevelAS()
   for(const HelloVulkan::ObjInstance& inst : m_instances)
   {
     VkAccelerationStructureInstanceKHR rayInst{};
-    rayInst.transform                              = nvvk::toTransformMatrixKHR(inst.transform);  // 实例变换矩阵
-    rayInst.instanceCustomIndex                    = inst.objIndex;  // 自定义索引用于shader区分
-    rayInst.accelerationStructureReference         = m_rtBuilder.getBlasDeviceAddress(inst.objIndex);  // BLAS地址
-    rayInst.flags                                  = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
-    rayInst.mask                                   = 0xFF;  // 所有射线都能命中
-    rayInst.instanceShaderBindingTableRecordOffset = 0;     // 所有实例共用同一hitgroup
+    rayInst.transform = nvvk::toTransformMatrixKHR(inst.transform);  // 实例变换矩阵
+    rayInst.mask      = inst.visible ? 0xFF : 0x00;                 // 隐藏的实例不被任何射线命中
+    setInstanceObjectData(rayInst, inst.objIndex);
     m_tlas.emplace_back(rayInst);
   }
 
   // 设置TLAS构建标志（优先快速追踪，允许更新）
   m_rtFlags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
-  m_rtBuilder.buildTlas(m_tlas, m_rtFlags);
+  m_tlasBuilder.build(m_tlas, m_rtFlags);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 实例中由所引用模型决定的字段：
+// - 自定义索引（shader中的物体描述索引）和BLAS地址
+// - SBT记录偏移 = 模型索引，每个模型一条hit记录（见 createRtSbt）
+// - 非透明模型的实例强制opaque，任何射线都不会调用any-hit
+void HelloVulkan::setInstanceObjectData(VkAccelerationStructureInstanceKHR& rayInst, uint32_t objIndex) const
+{
+  rayInst.instanceCustomIndex                    = objIndex;
+  rayInst.accelerationStructureReference         = m_blasBuilder.getAddress(objIndex);
+  rayInst.instanceShaderBindingTableRecordOffset = objIndex;
+  rayInst.flags                                  = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+  if(m_objModel[objIndex].hitGroup != eHitTransparent)
+    rayInst.flags |= VK_GEOMETRY_INSTANCE_FORCE_OPAQUE_BIT_KHR;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -732,6 +1392,10 @@ void HelloVulkan::createRtDescriptorSet()
                                    VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
   // 添加输出图像绑定（只在raygen可见）
   m_rtDescSetLayoutBind.addBinding(RtxBindings::eOutImage, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+  // 累积buffer和收敛统计（只在raygen可见）
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eAccum, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eAccumStats, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+  m_rtDescSetLayoutBind.addBinding(RtxBindings::eAdaptiveTiles, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
 
   // 创建描述符池和布局
   m_rtDescPool      = m_rtDescSetLayoutBind.createPool(m_device);
@@ -745,15 +1409,21 @@ void HelloVulkan::createRtDescriptorSet()
   vkAllocateDescriptorSets(m_device, &allocateInfo, &m_rtDescSet);
 
   // 填充TLAS和输出图像信息
-  VkAccelerationStructureKHR tlas = m_rtBuilder.getAccelerationStructure();
+  VkAccelerationStructureKHR tlas = m_tlasBuilder.getAccelerationStructure();
   VkWriteDescriptorSetAccelerationStructureKHR descASInfo{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR};
   descASInfo.accelerationStructureCount = 1;
   descASInfo.pAccelerationStructures    = &tlas;
-  VkDescriptorImageInfo imageInfo{{}, m_offscreenColor.descriptor.imageView, VK_IMAGE_LAYOUT_GENERAL};
+  VkDescriptorImageInfo  imageInfo{{}, m_offscreenColor.descriptor.imageView, VK_IMAGE_LAYOUT_GENERAL};
+  VkDescriptorBufferInfo accumInfo{m_accumBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo statsInfo{m_accumStats.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo tilesInfo{m_adaptiveTiles.buffer, 0, VK_WHOLE_SIZE};
 
   std::vector<VkWriteDescriptorSet> writes;
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eTlas, &descASInfo));
   writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eOutImage, &imageInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eAccum, &accumInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eAccumStats, &statsInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eAdaptiveTiles, &tilesInfo));
   vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
@@ -764,8 +1434,15 @@ void HelloVulkan::updateRtDescriptorSet()
 {
   // (1) Output buffer: 将新的offscreen color图像信息填入描述符集
   VkDescriptorImageInfo imageInfo{{}, m_offscreenColor.descriptor.imageView, VK_IMAGE_LAYOUT_GENERAL};
-  VkWriteDescriptorSet  wds = m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eOutImage, &imageInfo);
-  vkUpdateDescriptorSets(m_device, 1, &wds, 0, nullptr);
+  // (2) 累积buffer和自适应采样的tile随尺寸重建
+  VkDescriptorBufferInfo accumInfo{m_accumBuffer.buffer, 0, VK_WHOLE_SIZE};
+  VkDescriptorBufferInfo tilesInfo{m_adaptiveTiles.buffer, 0, VK_WHOLE_SIZE};
+
+  std::vector<VkWriteDescriptorSet> writes;
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eOutImage, &imageInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eAccum, &accumInfo));
+  writes.emplace_back(m_rtDescSetLayoutBind.makeWrite(m_rtDescSet, RtxBindings::eAdaptiveTiles, &tilesInfo));
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -790,34 +1467,48 @@ void HelloVulkan::createRtPipeline()
     eMiss,
     eMiss2,
     eClosestHit,
+    eAnyHit,
+    eEmissiveHit,
     eShaderGroupCount
   };
 
-  // 1. 加载shader模块并创建VkPipelineShaderStageCreateInfo数组
-  std::array<VkPipelineShaderStageCreateInfo, eShaderGroupCount> stages{};
-  VkPipelineShaderStageCreateInfo stage{VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-  stage.pName = "main";  // 所有shader入口均为main
-
-  // Raygen shader（主射线生成着色器）
-  stage.module = nvvk::createShaderModule(m_device, nvh::loadFile("spv/raytrace.rgen.spv", true, defaultSearchPaths, true));
-  stage.stage     = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
-  stages[eRaygen] = stage;
-
-  // Miss shader（主射线未命中时调用）
-  stage.module = nvvk::createShaderModule(m_device, nvh::loadFile("spv/raytrace.rmiss.spv", true, defaultSearchPaths, true));
-  stage.stage   = VK_SHADER_STAGE_MISS_BIT_KHR;
-  stages[eMiss] = stage;
-
-  // Shadow Miss shader（二次/阴影射线未命中时调用，判断是否被遮挡）
-  stage.module =
-      nvvk::createShaderModule(m_device, nvh::loadFile("spv/raytraceShadow.rmiss.spv", true, defaultSearchPaths, true));
-  stage.stage    = VK_SHADER_STAGE_MISS_BIT_KHR;
-  stages[eMiss2] = stage;
-
-  // Closest Hit shader（主射线命中三角面时调用）
-  stage.module = nvvk::createShaderModule(m_device, nvh::loadFile("spv/raytrace.rchit.spv", true, defaultSearchPaths, true));
-  stage.stage         = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-  stages[eClosestHit] = stage;
+  // 1. 加载shader模块并创建VkPipelineShaderStageCreateInfo数组（所有管线变体共用，destroyResources 时销毁）
+  //    创建模块在工作线程上并行执行
+  std::vector<VkPipelineShaderStageCreateInfo> stages(eShaderGroupCount);
+  const std::pair<const char*, VkShaderStageFlagBits> stageFiles[eShaderGroupCount] = {
+      {"raytrace.rgen.spv", VK_SHADER_STAGE_RAYGEN_BIT_KHR},         // Raygen shader（主射线生成着色器）
+      {"raytrace.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_KHR},          // Miss shader（主射线未命中时调用）
+      {"raytraceShadow.rmiss.spv", VK_SHADER_STAGE_MISS_BIT_KHR},    // Shadow Miss shader（阴影射线未命中，判断是否被遮挡）
+      {"raytrace.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},  // Closest Hit shader（主射线命中三角面时调用）
+      {"raytrace.rahit.spv", VK_SHADER_STAGE_ANY_HIT_BIT_KHR},      // Any Hit shader（alpha测试和dissolve透明）
+      {"raytrace_emissive.rchit.spv", VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR},  // 自发光材质的Closest Hit，直接返回emission
+  };
+  std::vector<std::thread> loaders;
+  for(uint32_t i = 0; i < eShaderGroupCount; i++)
+  {
+    loaders.emplace_back([&, i]() {
+      VkPipelineShaderStageCreateInfo& stage = stages[i];
+      stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+      stage.pName  = "main";  // 所有shader入口均为main
+      stage.stage  = stageFiles[i].second;
+      stage.module = nvvk::createShaderModule(m_device, spirv::load(stageFiles[i].first));
+    });
+  }
+  // 路径追踪变体替换的模块：miss 和所有hit group的closest hit，着色和后续射线由 raytrace.rgen 中的循环完成
+  std::vector<VkShaderModule>            pathModules(eShaderGroupCount, VK_NULL_HANDLE);
+  const std::pair<uint32_t, const char*> pathFiles[] = {
+      {eMiss, "raytrace_path.rmiss.spv"},
+      {eClosestHit, "raytrace_path.rchit.spv"},
+      {eEmissiveHit, "raytrace_path.rchit.spv"},
+  };
+  for(const auto& pathFile : pathFiles)
+  {
+    loaders.emplace_back([&, pathFile]() {
+      pathModules[pathFile.first] = nvvk::createShaderModule(m_device, spirv::load(pathFile.second));
+    });
+  }
+  for(auto& loader : loaders)
+    loader.join();
 
   // 2. 配置Shader Group
   VkRayTracingShaderGroupCreateInfoKHR group{VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR};
@@ -841,15 +1532,23 @@ void HelloVulkan::createRtPipeline()
   group.generalShader = eMiss2;
   m_rtShaderGroups.push_back(group);
 
-  // Closest Hit group
-  group.type             = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-  group.generalShader    = VK_SHADER_UNUSED_KHR;
+  // Hit groups，按材质类别各一个，顺序与 HitGroups（host_device.h）一致，放在最后（见 createRtSbt）
+  group.type          = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+  group.generalShader = VK_SHADER_UNUSED_KHR;
+  // eHitOpaque
   group.closestHitShader = eClosestHit;
   m_rtShaderGroups.push_back(group);
+  // eHitTransparent
+  group.closestHitShader = eClosestHit;
+  group.anyHitShader     = eAnyHit;
+  m_rtShaderGroups.push_back(group);
+  // eHitEmissive
+  group.closestHitShader = eEmissiveHit;
+  group.anyHitShader     = VK_SHADER_UNUSED_KHR;
+  m_rtShaderGroups.push_back(group);
 
   // 3. 配置Push Constant，用于传递光线追踪参数（如光源、清屏色等）
-  VkPushConstantRange pushConstant{VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
-                                   0, sizeof(PushConstantRay)};
+  VkPushConstantRange pushConstant{kRtPushStages, 0, sizeof(PushConstantRay)};
 
   // 4. 创建Pipeline Layout（包含光追和通用描述符集以及push constant）
   VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
@@ -863,25 +1562,173 @@ void HelloVulkan::createRtPipeline()
 
   vkCreatePipelineLayout(m_device, &pipelineLayoutCreateInfo, nullptr, &m_rtPipelineLayout);
 
-  // 5. 创建Ray Tracing Pipeline对象
+  m_rtStages      = std::move(stages);
+  m_rtPathModules = std::move(pathModules);
+
+  // 5. 并行编译当前设置和预编译列表对应的Ray Tracing Pipeline变体，然后选择当前变体
+  std::vector<RtVariantKey> keys{currentRtVariantKey()};
+  for(uint32_t bounces : m_rtPrecompileBounces)
+  {
+    RtVariantKey key   = keys.front();
+    key.recursionDepth = key.pathTracing ? 1 : std::min(bounces + 2, m_rtProperties.maxRayRecursionDepth);
+    keys.push_back(key);
+  }
+  createRtPipelineVariants(keys);
+  selectRtPipeline();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 当前设置和场景对应的管线变体：
+// - 递归深度 = 反射次数 + 2（主射线 + 阴影射线），深度越小驱动分配的栈越小
+// - 光源类型、阴影、纹理作为closest hit的特化常量，关闭的功能在编译时被删除，减少分支发散和寄存器压力
+// - 路径追踪：所有射线都由raygen的循环发射，递归深度固定为1，与反射次数无关
+HelloVulkan::RtVariantKey HelloVulkan::currentRtVariantKey() const
+{
+  RtVariantKey key;
+  key.recursionDepth = std::min(m_renderSettings.maxBounces + 2, m_rtProperties.maxRayRecursionDepth);
+  key.lightType      = m_rtSpecializeLight ? m_pcRaster.lightType : -1;
+  key.shadows        = m_renderSettings.shadows;
+  key.textures       = m_sceneTextured;
+  key.pathTracing    = m_renderSettings.pathTracing;
+  if(key.pathTracing)
+    key.recursionDepth = 1;
+  return key;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 创建尚不存在的管线变体：每个变体在自己的线程上编译（都使用 m_pipelineCache，缓存内部同步），
+// 之后在当前线程依次创建SBT（需要提交上传命令）
+void HelloVulkan::createRtPipelineVariants(const std::vector<RtVariantKey>& keys)
+{
   VkRayTracingPipelineCreateInfoKHR rayPipelineInfo{VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR};
-  rayPipelineInfo.stageCount = static_cast<uint32_t>(stages.size());  // 所有着色器阶段
-  rayPipelineInfo.pStages    = stages.data();
+  rayPipelineInfo.stageCount = static_cast<uint32_t>(m_rtStages.size());  // 所有着色器阶段
+  rayPipelineInfo.pStages    = m_rtStages.data();
   rayPipelineInfo.groupCount = static_cast<uint32_t>(m_rtShaderGroups.size());  // 所有shader group
   rayPipelineInfo.pGroups    = m_rtShaderGroups.data();
+  rayPipelineInfo.layout     = m_rtPipelineLayout;
 
-  // 设置递归深度（如主射线+阴影射线=2即可，太大影响性能）
-  rayPipelineInfo.maxPipelineRayRecursionDepth = 2;
-  rayPipelineInfo.layout                       = m_rtPipelineLayout;
+  std::vector<RtVariantKey> missing;
+  for(const RtVariantKey& key : keys)
+  {
+    if(m_rtVariants.find(key) == m_rtVariants.end() && std::find(missing.begin(), missing.end(), key) == missing.end())
+      missing.push_back(key);
+  }
+  if(missing.empty())
+    return;
 
-  vkCreateRayTracingPipelinesKHR(m_device, {}, {}, 1, &rayPipelineInfo, nullptr, &m_rtPipeline);
+  // 与 raytrace.rgen / raytrace.rchit / raytrace.rahit 中的 constant_id 0..4 对应
+  struct Specialization
+  {
+    int32_t  lightType;
+    VkBool32 shadows;
+    VkBool32 textures;
+    uint32_t maxBounces;
+    VkBool32 pathTracing;
+  };
+  const std::array<VkSpecializationMapEntry, 5> mapEntries{{
+      {0, offsetof(Specialization, lightType), sizeof(int32_t)},
+      {1, offsetof(Specialization, shadows), sizeof(VkBool32)},
+      {2, offsetof(Specialization, textures), sizeof(VkBool32)},
+      {3, offsetof(Specialization, maxBounces), sizeof(uint32_t)},
+      {4, offsetof(Specialization, pathTracing), sizeof(VkBool32)},
+  }};
+
+  std::vector<VkPipeline>  pipelines(missing.size(), VK_NULL_HANDLE);
+  std::vector<std::thread> workers;
+  for(size_t i = 0; i < missing.size(); i++)
+  {
+    workers.emplace_back([&, i, info = rayPipelineInfo]() mutable {
+      const RtVariantKey& key = missing[i];
+      Specialization      data{key.lightType, key.shadows, key.textures, key.recursionDepth > 2 ? key.recursionDepth - 2 : 0,
+                          key.pathTracing};
+      VkSpecializationInfo specialization{static_cast<uint32_t>(mapEntries.size()), mapEntries.data(), sizeof(data), &data};
+
+      // 特化常量作用于raygen、closest hit和any-hit；路径追踪变体替换miss和closest hit的模块
+      std::vector<VkPipelineShaderStageCreateInfo> stages = m_rtStages;
+      for(size_t s = 0; s < stages.size(); s++)
+      {
+        VkPipelineShaderStageCreateInfo& stage = stages[s];
+        if(stage.stage != VK_SHADER_STAGE_MISS_BIT_KHR)
+          stage.pSpecializationInfo = &specialization;
+        if(key.pathTracing && m_rtPathModules[s] != VK_NULL_HANDLE)
+          stage.module = m_rtPathModules[s];
+      }
+      info.pStages                      = stages.data();
+      info.maxPipelineRayRecursionDepth = key.recursionDepth;
+      vkCreateRayTracingPipelinesKHR(m_device, {}, m_pipelineCache, 1, &info, nullptr, &pipelines[i]);
+    });
+  }
+  for(auto& worker : workers)
+    worker.join();
+
+  for(size_t i = 0; i < missing.size(); i++)
+  {
+    const RtVariantKey& key     = missing[i];
+    RtPipelineVariant&  variant = m_rtVariants[key];
+    variant.pipeline            = pipelines[i];
+    std::string name = "RtPipeline_depth" + std::to_string(key.recursionDepth) + "_light" + std::to_string(key.lightType)
+                       + (key.shadows ? "_shadows" : "") + (key.textures ? "_textures" : "") + (key.pathTracing ? "_path" : "");
+    m_debug.setObjectName(variant.pipeline, name);
+
+    createRtSbt(variant);
+    LOGI("Created ray tracing pipeline variant %s\n", name.c_str());
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// 切换到当前设置对应的光追管线，首次使用时创建并缓存（每个变体有自己的SBT）
+// 每帧追踪前调用，变体已存在时只是一次查找
+void HelloVulkan::selectRtPipeline()
+{
+  const RtVariantKey key = currentRtVariantKey();
+  createRtPipelineVariants({key});
+  // 模型增删后重建所有变体的SBT（调用时上一帧已执行完）
+  if(m_sbtDirty)
+  {
+    for(auto& [variantKey, variant] : m_rtVariants)
+      createRtSbt(variant);
+    m_sbtDirty = false;
+  }
+  RtPipelineVariant& variant = m_rtVariants[key];
+  m_rtPipeline               = variant.pipeline;
+  m_sbtWrapper               = variant.sbt.get();
+}
 
-  // 6. 创建SBT（Shader Binding Table），用于vkCmdTraceRays调度shader
-  m_sbtWrapper.create(m_rtPipeline, rayPipelineInfo);
+//--------------------------------------------------------------------------------------------------
+// 创建变体的SBT（Shader Binding Table），用于vkCmdTraceRays调度shader
+// - raygen、miss、shadow miss各一条记录
+// - 每个模型一条hit记录：句柄为模型材质类别的hit group，数据为模型的 HitRecord
+//   TLAS实例的SBT记录偏移为模型索引（见 setInstanceObjectData），射线的 sbtRecordOffset/Stride 都是0
+// 同一warp中命中同类材质的射线执行同一个特化的shader，透明和自发光的分支不再出现在opaque的closest hit里
+void HelloVulkan::createRtSbt(RtPipelineVariant& variant)
+{
+  if(variant.sbt)
+    variant.sbt->destroy();
+  variant.sbt = std::make_unique<nvvk::SBTWrapper>();
+  variant.sbt->setup(m_device, m_graphicsQueueIndex, &m_alloc, m_rtProperties);
+
+  const auto firstHitGroup = static_cast<uint32_t>(m_rtShaderGroups.size()) - eHitGroupCount;
+  variant.sbt->addIndex(nvvk::SBTWrapper::eRaygen, 0);
+  variant.sbt->addIndex(nvvk::SBTWrapper::eMiss, 1);
+  variant.sbt->addIndex(nvvk::SBTWrapper::eMiss, 2);
+  for(uint32_t i = 0; i < static_cast<uint32_t>(m_objModel.size()); i++)
+  {
+    variant.sbt->addIndex(nvvk::SBTWrapper::eHit, firstHitGroup + m_objModel[i].hitGroup);
+    variant.sbt->addData(nvvk::SBTWrapper::eHit, i, m_objModel[i].hitRecord);
+  }
+  // 索引是手动添加的：不传管线创建信息，否则会按shader group重新生成一组索引
+  variant.sbt->create(variant.pipeline);
+}
 
-  // 清理shader模块资源
-  for(auto& s : stages)
-    vkDestroyShaderModule(m_device, s.module, nullptr);
+//--------------------------------------------------------------------------------------------------
+// 应用渲染设置：影响画面的改变会重新累积，管线变体在下一次追踪前切换（已创建过的直接复用）
+void HelloVulkan::setRenderSettings(const RenderSettings& settings)
+{
+  if(settings == m_renderSettings)
+    return;
+  m_renderSettings     = settings;
+  m_renderSettings.spp = std::max(m_renderSettings.spp, 1u);
+  resetAccumulation();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -893,32 +1740,213 @@ void HelloVulkan::createRtPipeline()
 //   2. 绑定Ray Tracing管线和描述符集
 //   3. 配置并绑定SBT（Shader Binding Table）
 //   4. 调用vkCmdTraceRaysKHR发射光线，实现全屏光线追踪
+// 分块渲染时由 RayTraceApp 分别调用 beginRaytrace / traceRegions / endRaytrace
 void HelloVulkan::raytrace(const VkCommandBuffer& cmdBuf, const glm::vec4& clearColor)
 {
   m_debug.beginLabel(cmdBuf, "Ray trace");
-  // 1. 初始化push constant内容
+  if(beginRaytrace(clearColor))
+  {
+    traceRegions(cmdBuf, {VkRect2D{{0, 0}, m_size}});
+    endRaytrace(cmdBuf);
+  }
+  m_debug.endLabel(cmdBuf);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 一帧光追的开始：检测需要重新累积的改变，填充本帧的push constant
+// 返回 false 表示已收敛，本帧不发射光线，输出图像保持上一帧的结果
+bool HelloVulkan::beginRaytrace(const glm::vec4& clearColor)
+{
+  // 光源或背景改变时重新累积
+  if(m_pcRay.clearColor != clearColor || m_pcRay.lightPosition != m_pcRaster.lightPosition
+     || m_pcRay.lightIntensity != m_pcRaster.lightIntensity || m_pcRay.lightType != m_pcRaster.lightType)
+    resetAccumulation();
+
+  m_traced = !isConverged();
+  if(!m_traced)
+    return false;
+
+  // 反射次数、光源类型、阴影或场景纹理改变时切换管线变体
+  selectRtPipeline();
+
+  // 初始化push constant内容
   m_pcRay.clearColor     = clearColor;
   m_pcRay.lightPosition  = m_pcRaster.lightPosition;
   m_pcRay.lightIntensity = m_pcRaster.lightIntensity;
   m_pcRay.lightType      = m_pcRaster.lightType;
+  // 每个像素的ray cone扩散角，用于选择纹理mip
+  m_pcRay.pixelSpreadAngle = std::atan(2.0f * std::tan(glm::radians(CameraManip.getFov()) * 0.5f) / float(m_size.height));
+  m_pcRay.textureFeedback  = m_texStreamer.isEnabled() ? 1 : 0;
+  // 已累积的帧数（0 时shader覆盖累积buffer）和收敛判定阈值；不累积时每帧都从头开始
+  m_pcRay.frameIndex        = m_renderSettings.progressiveAccumulation ? m_accumFrame : 0;
+  m_pcRay.varianceThreshold = m_accumSettings.varianceThreshold;
+  // 渲染设置；Whitted模式的反射次数受管线递归深度限制（主射线和阴影射线各占一层），路径追踪在raygen中循环，不受限制
+  const uint32_t maxDepth  = m_rtProperties.maxRayRecursionDepth;
+  m_pcRay.samplesPerPixel  = m_renderSettings.spp;
+  m_pcRay.maxBounces       = m_renderSettings.pathTracing ? m_renderSettings.maxBounces :
+                                                            std::min(m_renderSettings.maxBounces, maxDepth > 2 ? maxDepth - 2 : 0u);
+  m_pcRay.rrBounceOffset   = m_renderSettings.rrBounceOffset;
+  m_pcRay.rrInvMinTermProb = m_renderSettings.rrInvMinTermProb;
+  m_pcRay.jitteredSampling = m_renderSettings.jitteredSampling ? 1 : 0;
+  // 自适应采样：先均匀采样 minSamples 个样本估计误差（warm-up），之后按tile的采样数追踪
+  const uint32_t warmupSamples = std::max(m_accumSettings.minSamples, 2u);
+  m_pcRay.adaptiveMode         = !isAdaptive() ? 0 : (getAccumulatedSamples() < warmupSamples ? 1 : 2);
+  m_pcRay.imageSize            = {m_size.width, m_size.height};
+  return true;
+}
 
-  // 2. 绑定管线与描述符集
+//--------------------------------------------------------------------------------------------------
+// 对图像中的若干区域发射光线，每个区域一次 vkCmdTraceRaysKHR（区域左上角经push constant传给raygen）
+// 一帧的所有区域使用相同的帧序号和采样数，可以分多个命令缓冲提交；前后写时间戳，getTraceTimeMs 返回这些区域的耗时
+void HelloVulkan::traceRegions(const VkCommandBuffer& cmdBuf, const std::vector<VkRect2D>& regions)
+{
+  // 绑定管线与描述符集：光追和场景通用
   std::vector<VkDescriptorSet> descSets{m_rtDescSet, m_descSet};
   vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtPipeline);
-  // 绑定两个描述符集：光追和场景通用
   vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, m_rtPipelineLayout, 0,
                           (uint32_t)descSets.size(), descSets.data(), 0, nullptr);
-  // 绑定push constant数据
-  vkCmdPushConstants(cmdBuf, m_rtPipelineLayout,
-                     VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_MISS_BIT_KHR,
-                     0, sizeof(PushConstantRay), &m_pcRay);
 
-  // 3. 获取SBT各区域信息
-  auto& regions = m_sbtWrapper.getRegions();
-  // 4. 发射光线（每像素一条主射线，width*height次）
-  vkCmdTraceRaysKHR(cmdBuf, &regions[0], &regions[1], &regions[2], &regions[3], m_size.width, m_size.height, 1);
+  // 重新累积后的第一次追踪：清零tile的误差和采样数，raygen对 maxError 做atomicMax
+  if(m_adaptiveTilesClear)
+  {
+    vkCmdFillBuffer(cmdBuf, m_adaptiveTiles.buffer, 0, VK_WHOLE_SIZE, 0);
+    VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &barrier, 0, nullptr, 0, nullptr);
+    m_adaptiveTilesClear = false;
+  }
 
-  m_debug.endLabel(cmdBuf);
+  // SBT各区域信息
+  auto& sbtRegions = m_sbtWrapper->getRegions();
+  vkCmdResetQueryPool(cmdBuf, m_traceQueryPool, 0, 2);
+  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_traceQueryPool, 0);
+  for(const VkRect2D& region : regions)
+  {
+    m_pcRay.tileOffset = {uint32_t(region.offset.x), uint32_t(region.offset.y)};
+    vkCmdPushConstants(cmdBuf, m_rtPipelineLayout, kRtPushStages, 0, sizeof(PushConstantRay), &m_pcRay);
+    vkCmdTraceRaysKHR(cmdBuf, &sbtRegions[0], &sbtRegions[1], &sbtRegions[2], &sbtRegions[3], region.extent.width,
+                      region.extent.height, 1);
+  }
+  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, m_traceQueryPool, 1);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 一帧光追的结束：整幅图像都追踪完之后调用，累积帧数加一，执行自适应采样的计算pass
+void HelloVulkan::endRaytrace(const VkCommandBuffer& cmdBuf)
+{
+  const bool warmup = m_pcRay.adaptiveMode == 1;
+  m_accumFrame++;
+  if(m_pcRay.adaptiveMode != 0)
+    recordAdaptivePass(cmdBuf, warmup ? getAccumulatedSamples() : 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 创建累积buffer（每像素 rgb 样本和 + 亮度平方和）和host可见的收敛统计，尺寸改变后重新累积
+void HelloVulkan::createAccumulationBuffer()
+{
+  m_alloc.destroy(m_accumBuffer);
+  m_accumBuffer = m_alloc.createBuffer(VkDeviceSize(m_size.width) * m_size.height * sizeof(glm::vec4),
+                                       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_debug.setObjectName(m_accumBuffer.buffer, "Accumulation");
+
+  // 每个tile的误差和采样数，在下一次光追之前清零（见 resetAccumulation）
+  const uint32_t tilesX = (m_size.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+  const uint32_t tilesY = (m_size.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+  m_adaptiveTileCount   = tilesX * tilesY;
+  m_alloc.destroy(m_adaptiveTiles);
+  m_adaptiveTiles = m_alloc.createBuffer(VkDeviceSize(m_adaptiveTileCount) * sizeof(AdaptiveTile),
+                                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                             | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  m_debug.setObjectName(m_adaptiveTiles.buffer, "AdaptiveTiles");
+
+  if(m_accumStats.buffer == VK_NULL_HANDLE)
+  {
+    m_accumStats = m_alloc.createBuffer(sizeof(AccumStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_accumStatsMapped  = static_cast<AccumStats*>(m_alloc.map(m_accumStats));
+    *m_accumStatsMapped = AccumStats{};
+    m_debug.setObjectName(m_accumStats.buffer, "AccumStats");
+  }
+  resetAccumulation();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 下一帧从第一个样本重新累积；摄像机、TLAS、光源、纹理或尺寸改变时调用，材质修改后由调用者调用
+void HelloVulkan::resetAccumulation()
+{
+  m_accumFrame         = 0;
+  m_unconvergedPixels  = ~0u;
+  m_adaptiveTilesClear = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 帧完成后（submitFrame 之后）读取并清零未收敛的像素数
+void HelloVulkan::updateAccumulation()
+{
+  if(!m_traced || !m_accumStatsMapped)
+    return;
+  m_unconvergedPixels = m_accumStatsMapped->unconvergedPixels;
+  m_activeTiles       = m_accumStatsMapped->activeTiles;
+  *m_accumStatsMapped = AccumStats{};
+}
+
+//--------------------------------------------------------------------------------------------------
+// 达到 maxSamples，或至少 minSamples 个样本后所有像素的相对误差都低于 varianceThreshold
+// 不累积时一帧（spp个样本）就是最终结果
+bool HelloVulkan::isConverged() const
+{
+  if(!m_renderSettings.progressiveAccumulation)
+    return m_accumFrame > 0;
+  const uint32_t samples = getAccumulatedSamples();
+  // 自适应采样时各tile的样本数不同，maxSamples 由计算着色器逐tile限制，停止的tile不再计入未收敛像素
+  if(!isAdaptive() && m_accumSettings.maxSamples > 0 && samples >= m_accumSettings.maxSamples)
+    return true;
+  return m_accumSettings.varianceThreshold > 0.0f && samples >= std::max(m_accumSettings.minSamples, 2u) && m_unconvergedPixels == 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 自适应采样只在累积且有误差阈值时生效
+bool HelloVulkan::isAdaptive() const
+{
+  return m_accumSettings.adaptive && m_renderSettings.progressiveAccumulation && m_accumSettings.varianceThreshold > 0.0f
+         && m_adaptivePipeline != VK_NULL_HANDLE;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 光追之后执行：读取raygen写入的tile误差，生成下一帧每个tile的采样数（0 表示该tile停止）
+// warmupSamples: 刚完成的是均匀采样帧时为每像素的累计样本数，自适应帧为 0
+void HelloVulkan::recordAdaptivePass(const VkCommandBuffer& cmdBuf, uint32_t warmupSamples)
+{
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+
+  PushConstantAdaptive pc{};
+  pc.tileAddress        = nvvk::getBufferDeviceAddress(m_device, m_adaptiveTiles.buffer);
+  pc.statsAddress       = nvvk::getBufferDeviceAddress(m_device, m_accumStats.buffer);
+  pc.tileCount          = m_adaptiveTileCount;
+  pc.warmupSamples      = warmupSamples;
+  pc.minSamplesPerFrame = m_renderSettings.spp;
+  pc.maxSamplesPerFrame = std::max(m_accumSettings.maxSamplesPerFrame, m_renderSettings.spp);
+  pc.maxSamples         = m_accumSettings.maxSamples > 0 ? m_accumSettings.maxSamples : ~0u;
+  pc.varianceThreshold  = m_accumSettings.varianceThreshold;
+
+  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, m_adaptivePipeline);
+  vkCmdPushConstants(cmdBuf, m_adaptivePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantAdaptive), &pc);
+  vkCmdDispatch(cmdBuf, (m_adaptiveTileCount + 63) / 64, 1, 1);
+
+  // 下一帧的raygen读取新的采样数
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
 }
 
 //-----------------------------------------------------------------------------------------------------
@@ -935,19 +1963,8 @@ void HelloVulkan::animationInstances(float time)
   const float radius      = wusonLength / (2.f * sin(deltaAngle / 2.0f));
   const float offset      = time * 0.5f;  // 时间偏移，实现流畅转动效果
 
-  for(int i = 0; i < nbWuson; i++)
-  {
-    int       wusonIdx  = i + 1;
-    glm::mat4 transform = m_instances[wusonIdx].transform;
-    transform           = glm::rotate(transform, i * deltaAngle + offset, glm::vec3(0.f, 1.f, 0.f));
-    transform           = glm::translate(transform, glm::vec3(radius, 0.f, 0.f));
-
-    VkAccelerationStructureInstanceKHR& tinst = m_tlas[wusonIdx];
-    tinst.transform                           = nvvk::toTransformMatrixKHR(transform);
-  }
-
-  // 动画后更新TLAS，使光追实例变换生效
-  m_rtBuilder.buildTlas(m_tlas, m_rtFlags, true);
+  // 变换由计算着色器直接写入显存中的实例数组，host端不再逐个实例计算和上传；在本帧的 flushTlas 中执行
+  m_tlasBuilder.animate(1, static_cast<uint32_t>(nbWuson), m_instances[1].transform, offset, radius);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -973,8 +1990,7 @@ void HelloVulkan::animationObject(float time)
   genCmdBuf.submitAndWait(cmdBuf);
 
   // 动画后更新该球的BLAS，使光追结构与顶点位置同步
-  m_rtBuilder.updateBlas(sphereId, m_blas[sphereId],
-                         VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR);
+  refitBlas(sphereId);
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -1020,10 +2036,9 @@ void HelloVulkan::createCompPipelines()
 
   // 加载编译好的计算着色器SPIR-V
   computePipelineCreateInfo.stage =
-      nvvk::createShaderStageInfo(m_device, nvh::loadFile("spv/anim.comp.spv", true, defaultSearchPaths, true),
-                                  VK_SHADER_STAGE_COMPUTE_BIT);
+      nvvk::createShaderStageInfo(m_device, spirv::load("anim.comp.spv"), VK_SHADER_STAGE_COMPUTE_BIT);
 
-  vkCreateComputePipelines(m_device, {}, 1, &computePipelineCreateInfo, nullptr, &m_compPipeline);
+  vkCreateComputePipelines(m_device, m_pipelineCache, 1, &computePipelineCreateInfo, nullptr, &m_compPipeline);
 
   vkDestroyShaderModule(m_device, computePipelineCreateInfo.stage.module, nullptr);
 }
@@ -1034,10 +2049,8 @@ void HelloVulkan::createCompPipelines()
 //--------------------------------------------------------------------------------------------------
 void HelloVulkan::updateTlas(uint32_t mesh_Id,glm::mat4 transform)
 {
-  VkAccelerationStructureInstanceKHR& tinst = m_tlas[mesh_Id];
-  tinst.transform                           = nvvk::toTransformMatrixKHR(transform);
-  // Updating the top level acceleration structure
-  m_rtBuilder.buildTlas(m_tlas, m_rtFlags, true);
+  // 只记入dirty集合，TLAS在本帧追踪前统一更新
+  setInstanceTransform(mesh_Id, transform);
 }
 // 动画处理球体对象的顶点，在 C++ 端进行缩放
 void HelloVulkan::updateBlas(uint32_t mesh_Id)
@@ -1055,8 +2068,32 @@ void HelloVulkan::updateBlas(uint32_t mesh_Id)
     nvvk::CommandPool genCmdBuf(m_device, m_graphicsQueueIndex);
     VkCommandBuffer cmdBuf = genCmdBuf.createCommandBuffer();
 
-    // 更新模型的顶点数量
-    model.nbVertices = static_cast<uint32_t>(now_vertices.size());
+    // 更新模型的顶点和索引数量，几何变化后磁盘缓存键也随之改变
+    // 调用者可能用原始三角形顺序覆盖了loader，重新按材质排序，与显存中的索引一致（host构建会读取它）
+    // 拓扑或geometry划分改变时（如Hydra中原地更新的mesh），索引、材质索引和GeometryDesc也要重新上传
+    const ModelLoader& loader = m_Loader[mesh_Id];
+    model.subsets             = buildSubsets(m_Loader[mesh_Id], m_splitByMaterial, model.alphaRanges);
+    model.nbIndices           = static_cast<uint32_t>(loader.m_indices.size());
+    model.nbVertices          = static_cast<uint32_t>(now_vertices.size());
+    model.geometryHash        = hashGeometry(loader);
+    const std::vector<GeometryDesc> geometries      = geometryDescs(model.subsets);
+    const uint64_t                  topologyHash    = hashTopology(loader, geometries);
+    const bool                      topologyChanged = topologyHash != model.topologyHash;
+    model.topologyHash                              = topologyHash;
+
+    // geometry的opaque标志和用到的材质可能随三角形材质改变，SBT记录变化时重建SBT并更新实例的FORCE_OPAQUE
+    const uint32_t hitGroup      = model.hitGroup;
+    const int      materialIndex = model.hitRecord.materialIndex;
+    classifyHitGroup(m_Loader[mesh_Id], model);
+    if(model.hitGroup != hitGroup || model.hitRecord.materialIndex != materialIndex)
+    {
+      m_sbtDirty = true;
+      for(size_t i = 0; i < m_instances.size() && i < m_tlas.size(); i++)
+      {
+        if(m_instances[i].objIndex == mesh_Id)
+          setInstanceObject(static_cast<uint32_t>(i), mesh_Id);
+      }
+    }
 
 
     // 定义缓冲区使用标志
@@ -1068,14 +2105,81 @@ void HelloVulkan::updateBlas(uint32_t mesh_Id)
     m_alloc.destroy(model.vertexBuffer);
 
     // 创建新的顶点缓冲区并上传修改后的顶点数据
-    model.vertexBuffer = m_alloc.createBuffer(cmdBuf, now_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | rayTracingFlags);
+    model.vertexBuffer = createDeviceBuffer(now_vertices, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | rayTracingFlags);
+    if(topologyChanged)
+    {
+      m_alloc.destroy(model.indexBuffer);
+      m_alloc.destroy(model.matIndexBuffer);
+      m_alloc.destroy(model.geometryBuffer);
+      model.indexBuffer    = createDeviceBuffer(loader.m_indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | rayTracingFlags);
+      model.matIndexBuffer = createDeviceBuffer(loader.m_matIndx, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
+      model.geometryBuffer = createDeviceBuffer(geometries, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | flag);
+    }
+    m_stagingRing.flush();
+
+    // 新buffer的地址写回物体描述，否则shader仍读取已销毁的buffer
+    ObjDesc& desc      = m_objDesc[mesh_Id];
+    desc.vertexAddress = nvvk::getBufferDeviceAddress(m_device, model.vertexBuffer.buffer);
+    if(topologyChanged)
+    {
+      desc.indexAddress         = nvvk::getBufferDeviceAddress(m_device, model.indexBuffer.buffer);
+      desc.materialIndexAddress = nvvk::getBufferDeviceAddress(m_device, model.matIndexBuffer.buffer);
+      desc.geometryAddress      = nvvk::getBufferDeviceAddress(m_device, model.geometryBuffer.buffer);
+    }
+    updateObjDescriptionBuffer(cmdBuf);
 
     // 提交命令缓冲区并等待执行完成
     genCmdBuf.submitAndWait(cmdBuf);
+    m_alloc.finalizeAndReleaseStaging();
 
-    // 更新底层加速结构（BLAS），使用新的顶点缓冲区
-    m_rtBuilder.updateBlas(mesh_Id, m_blas[mesh_Id],
-                           VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR);
+    // 更新底层加速结构（BLAS），使用新的顶点缓冲区；顶点在host上，可以估计形变导致的包围盒增长
+    const std::vector<uint32_t>& indices = m_Loader[mesh_Id].m_indices;
+    float areaRatio = BlasBuilder::surfaceAreaRatio(reinterpret_cast<const uint8_t*>(now_vertices.data()) + offsetof(VertexObj, pos),
+                                                    sizeof(VertexObj), indices.data(), static_cast<uint32_t>(indices.size()));
+    refitBlas(mesh_Id, areaRatio);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 用模型当前的buffer重新生成BLAS输入并更新BLAS
+// 静态BLAS（已压缩，不可refit）或图元数改变时会被重建，此时把新地址写回引用它的TLAS实例
+// 形变过大或refit次数过多时BLAS排队重建，在 updateAccelerationStructures 中分摊执行
+void HelloVulkan::refitBlas(uint32_t objIndex, float areaRatio)
+{
+  m_blas[objIndex] = objectToVkGeometryKHR(m_objModel[objIndex]);
+  if(m_blasBuilder.update(objIndex, m_blas[objIndex], areaRatio))
+  {
+    m_objModel[objIndex].usage = m_blasBuilder.getUsage(objIndex);
+    for(size_t i = 0; i < m_instances.size() && i < m_tlas.size(); i++)
+    {
+      if(m_instances[i].objIndex == objIndex)
+        setInstanceObject(static_cast<uint32_t>(i), objIndex);
+    }
+  }
+  // BLAS的包围盒变了，TLAS也要refit（本帧追踪前统一执行）
+  m_tlasRefit = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 每帧结束时调用：执行本帧份额的排队BLAS重建（原地重建，地址不变），有重建时标记TLAS在下一帧追踪前refit
+// 每帧的refit/重建计数见 m_blasBuilder.getFrameCounters()
+void HelloVulkan::updateAccelerationStructures()
+{
+  if(m_blasBuilder.endFrame() > 0)
+    m_tlasRefit = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 最近一帧 traceRays 的GPU耗时（毫秒），在 submitFrame 之后调用
+float HelloVulkan::getTraceTimeMs()
+{
+  if(!m_traced)
+    return 0.0f;
+  uint64_t timestamps[2]{};
+  if(vkGetQueryPoolResults(m_device, m_traceQueryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                           VK_QUERY_RESULT_64_BIT)
+     != VK_SUCCESS)
+    return 0.0f;
+  return float(double(timestamps[1] - timestamps[0]) * m_timestampPeriod * 1e-6);
 }
 //-------------------------------------------------------------------------------------------------------------------
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -1185,6 +2289,47 @@ void HelloVulkan::saveOffscreenColorToFile(const char* filename)
   vkDestroyBuffer(device, stagingBuffer, nullptr);
   printf("Saved %s (%ux%u)\n", filename, w, h);
 }
+
+//--------------------------------------------------------------------------------------------------
+// 读取 m_offscreenColor 中的一个区域（RGBA float，按行紧密排列），用于分块渲染时预览已完成的块
+// 需在该区域的提交完成之后调用
+void HelloVulkan::readOffscreenRegion(const VkRect2D& region, std::vector<glm::vec4>& pixels)
+{
+  const VkDeviceSize size    = VkDeviceSize(region.extent.width) * region.extent.height * sizeof(glm::vec4);
+  nvvk::Buffer       staging = m_alloc.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  VkCommandBuffer cmd = createTempCmdBuffer();
+
+  VkImageMemoryBarrier imgBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  imgBarrier.oldLayout        = VK_IMAGE_LAYOUT_GENERAL;
+  imgBarrier.newLayout        = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  imgBarrier.image            = m_offscreenColor.image;
+  imgBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  imgBarrier.srcAccessMask    = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+  imgBarrier.dstAccessMask    = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &imgBarrier);
+
+  VkBufferImageCopy copy{};
+  copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  copy.imageOffset      = {region.offset.x, region.offset.y, 0};
+  copy.imageExtent      = {region.extent.width, region.extent.height, 1};
+  vkCmdCopyImageToBuffer(cmd, m_offscreenColor.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staging.buffer, 1, &copy);
+
+  std::swap(imgBarrier.oldLayout, imgBarrier.newLayout);
+  imgBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  imgBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &imgBarrier);
+
+  submitTempCmdBuffer(cmd);
+
+  pixels.resize(size_t(region.extent.width) * region.extent.height);
+  std::memcpy(pixels.data(), m_alloc.map(staging), size);
+  m_alloc.unmap(staging);
+  m_alloc.destroy(staging);
+}
 #if ENABLE_GL_VK_CONVERSION
 void HelloVulkan::createOutputImage()
 {
@@ -35,6 +35,16 @@
 #include "nvvk/sbtwrapper_vk.hpp"
 
 #include "ModelLoader.h"
+#include "texture_loader.hpp"
+#include "staging_ring.hpp"
+#include "texture_streamer.hpp"
+#include "blas_builder.hpp"
+#include "tlas_builder.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <tuple>
 
 //--------------------------------------------------------------------------------------------------
 // Simple rasterizer of OBJ objects
@@ -50,15 +60,55 @@ public:
   void createDescriptorSetLayout();
   void createGraphicsPipeline();
   void loadModel(ModelLoader& loader, glm::mat4 transform = glm::mat4(1));
+  uint32_t addModel(ModelLoader& loader, glm::mat4 transform = glm::mat4(1));
+  void     removeModel(uint32_t objIndex);
+  void     rebuildAccelerationStructures();
+  void     rebuildTopLevelAS();
+  uint32_t addInstance(uint32_t objIndex, const glm::mat4& transform);
+  uint32_t addInstances(uint32_t objIndex, const std::vector<glm::mat4>& transforms);
+  void     setInstanceTransform(uint32_t instIndex, const glm::mat4& transform);
+  void     setInstanceObject(uint32_t instIndex, uint32_t objIndex);
+  void     setInstanceVisible(uint32_t instIndex, bool visible);
+  void     flushTlas();
+  static uint64_t hashGeometry(const ModelLoader& loader);
   void updateDescriptorSet();
   void createUniformBuffer();
   void createObjDescriptionBuffer();
-  void createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures);
+  void updateObjDescriptionBuffer(const VkCommandBuffer& cmdBuf);
+  void updateTextureDescriptors(uint32_t first, uint32_t count);
+  void createTextureInfoBuffer();
+  void updateTextureStreaming();
+  void createTextureImages(const VkCommandBuffer& cmdBuf, const std::vector<std::string>& textures, std::vector<tex::AlphaRange>* alphaRanges = nullptr);
+  nvvk::Texture createTextureFromData(const VkCommandBuffer& cmdBuf, const TextureData& data, const VkSamplerCreateInfo& samplerCreateInfo);
+  bool          isFormatSampleable(VkFormat format);
   void updateUniformBuffer(const VkCommandBuffer& cmdBuf);
   void onResize(int /*w*/, int /*h*/);
   void destroyResources();
   void rasterize(const VkCommandBuffer& cmdBuff);
 
+  // 创建设备buffer并通过staging ring上传，使用前需 m_stagingRing.flush()
+  template <typename T>
+  nvvk::Buffer createDeviceBuffer(const std::vector<T>& data, VkBufferUsageFlags usage)
+  {
+    VkDeviceSize size   = sizeof(T) * data.size();
+    nvvk::Buffer buffer = m_alloc.createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_stagingRing.uploadBuffer(buffer.buffer, 0, data.data(), size);
+    return buffer;
+  }
+
+  // A run of triangles that becomes one geometry of the model's BLAS
+  struct MeshSubset
+  {
+    uint32_t firstPrimitive{0};  // First triangle in the index buffer
+    uint32_t primitiveCount{0};
+    int      material{-1};       // Material of the run, -1 when the mesh is not split (per-triangle lookup)
+    bool     opaque{true};       // Geometry gets VK_GEOMETRY_OPAQUE_BIT_KHR, any-hit is skipped
+  };
+  static std::vector<MeshSubset> buildSubsets(ModelLoader& loader, bool split, const std::vector<tex::AlphaRange>& alpha);
+  static std::vector<GeometryDesc>    geometryDescs(const std::vector<MeshSubset>& subsets);
+  static uint64_t                     hashTopology(const ModelLoader& loader, const std::vector<GeometryDesc>& geometries);
+  static std::vector<tex::AlphaRange> materialAlphaRanges(const ModelLoader& loader, const std::vector<tex::AlphaRange>& textureAlpha);
+
   // The OBJ model
   struct ObjModel
   {
@@ -68,12 +118,21 @@ public:
     nvvk::Buffer indexBuffer;     // Device buffer of the indices forming triangles
     nvvk::Buffer matColorBuffer;  // Device buffer of array of 'Wavefront material'
     nvvk::Buffer matIndexBuffer;  // Device buffer of array of 'Wavefront material'
+    nvvk::Buffer geometryBuffer;  // Device buffer of the 'GeometryDesc' of each BLAS geometry
+    std::vector<MeshSubset> subsets;  // BLAS geometries, a single one unless the mesh is split by material
+    BlasUsage    usage{BlasUsage::eStatic};  // Static meshes get a compacted BLAS, deformable ones can be refit
+    uint64_t     geometryHash{0};            // Content hash of vertices and indices, keys the on-disk BLAS cache
+    uint64_t     topologyHash{0};            // Indices, triangle materials and GeometryDesc, updateBlas re-uploads them on change
+    std::vector<tex::AlphaRange> alphaRanges;  // Texture alpha per material, empty for opaque ones (see buildSubsets)
+    uint32_t     hitGroup{eHitOpaque};       // Hit group of the model's SBT record, from its material class
+    HitRecord    hitRecord{};                // Per-material data of the model's SBT record
   };
 
   struct ObjInstance
   {
     glm::mat4 transform;    // Matrix of the instance
     uint32_t  objIndex{0};  // Model index reference
+    bool      visible{true};  // Hidden instances keep their slot but get a zero TLAS mask
   };
 
   // Information pushed at each draw call
@@ -90,6 +149,11 @@ public:
   std::vector<ObjModel>    m_objModel;   // Model on host
   std::vector<ObjDesc>     m_objDesc;    // Model description for device access
   std::vector<ObjInstance> m_instances;  // Scene model instances
+  bool                     m_splitByMaterial{false};  // Load meshes as one BLAS geometry per material (set before loading)
+  uint32_t                 m_alphaRangeResolution{256};  // Resolution of the host copy of texture alpha for triangle classification
+  std::vector<uint32_t>    m_tlasDirty;          // Instance slots changed since the last TLAS update
+  bool                     m_tlasRefit{false};   // A referenced BLAS changed in place, the TLAS needs a refit
+  bool                     m_tlasRebuild{false}; // Instances were added or removed, the TLAS needs a rebuild
 
   // Graphic pipeline
   VkPipelineLayout            m_pipelineLayout;
@@ -97,14 +161,20 @@ public:
   nvvk::DescriptorSetBindings m_descSetLayoutBind;
   VkDescriptorPool            m_descPool;
   VkDescriptorSetLayout       m_descSetLayout;
-  VkDescriptorSet             m_descSet;
+  VkDescriptorSet             m_descSet{VK_NULL_HANDLE};
 
   nvvk::Buffer m_bGlobals;  // Device-Host of the camera matrices
   nvvk::Buffer m_bObjDesc;  // Device buffer of the OBJ descriptions
+  uint32_t     m_objDescCapacity{0};  // Number of ObjDesc the buffer can hold, grows by doubling
+  uint32_t     m_maxTextures{4096};   // Capacity of the bindless texture array
 
-  std::vector<nvvk::Texture> m_textures;  // vector of all textures of the scene
+  std::vector<nvvk::Texture> m_textures;        // vector of all textures of the scene
+  TextureOptions             m_textureOptions;  // BC compression, resolution cap, mip and LOD bias options for loaded textures
+  TextureStreamer            m_texStreamer;     // Mip streaming under a VRAM budget, owns the TextureInfo buffer
 
   nvvk::ResourceAllocatorDma m_alloc;  // Allocator for buffer, images, acceleration structures
+  StagingRing                m_stagingRing;                // Fixed-size upload ring for geometry and textures
+  VkDeviceSize               m_stagingBudget{64ull << 20};  // Size of the staging ring, see StagingRing::setBudget
   nvvk::DebugUtil            m_debug;  // Utility to name objects
 
   // #Post - Draw the rendered image on a quad using a tonemapper
@@ -119,31 +189,137 @@ public:
 
   // #VKRay
   void initRayTracing();
-  auto objectToVkGeometryKHR(const ObjModel& model);
+  BlasInput objectToVkGeometryKHR(const ObjModel& model, const ModelLoader* loader = nullptr);
   void createBottomLevelAS();
   void createTopLevelAS();
   void createRtDescriptorSet();
   void updateRtDescriptorSet();
   void createRtPipeline();
+  void selectRtPipeline();
   void raytrace(const VkCommandBuffer& cmdBuf, const glm::vec4& clearColor);
+  bool beginRaytrace(const glm::vec4& clearColor);
+  void traceRegions(const VkCommandBuffer& cmdBuf, const std::vector<VkRect2D>& regions);
+  void endRaytrace(const VkCommandBuffer& cmdBuf);
+  VkExtent2D getSize() const { return m_size; }
+  void refitBlas(uint32_t objIndex, float areaRatio = 0.0f);
+  void updateAccelerationStructures();
+  float getTraceTimeMs();
 
   VkPhysicalDeviceRayTracingPipelinePropertiesKHR m_rtProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
-  nvvk::RaytracingBuilderKHR                        m_rtBuilder;
+  TlasBuilder                                       m_tlasBuilder;  // Device-resident instances, delta updates
+  BlasBuilder                                       m_blasBuilder;  // BLAS with per-mesh flags and compaction
+  bool                                              m_blasCompaction{true};
+  bool                                              m_blasHostBuild{false};  // Opt-in: build static BLAS on the CPU when the device supports it
+  std::string                                       m_asCacheDirectory;  // On-disk BLAS cache, empty disables it
+  VkQueryPool                                       m_traceQueryPool{VK_NULL_HANDLE};
+  float                                             m_timestampPeriod{1.0f};
   nvvk::DescriptorSetBindings                       m_rtDescSetLayoutBind;
   VkDescriptorPool                                  m_rtDescPool;
   VkDescriptorSetLayout                             m_rtDescSetLayout;
   VkDescriptorSet                                   m_rtDescSet;
   std::vector<VkRayTracingShaderGroupCreateInfoKHR> m_rtShaderGroups;
-  VkPipelineLayout                                  m_rtPipelineLayout;
-  VkPipeline                                        m_rtPipeline;
-  nvvk::SBTWrapper                                  m_sbtWrapper;
+  VkPipelineLayout                                  m_rtPipelineLayout{VK_NULL_HANDLE};
+  VkPipeline                                        m_rtPipeline{VK_NULL_HANDLE};  // Variant in use, owned by m_rtVariants
+  nvvk::SBTWrapper*                                 m_sbtWrapper{nullptr};         // SBT of the variant in use
+
+  // Ray tracing pipeline variants, created on first use and kept for the session
+  // The closest-hit shader is specialized on the key, features the scene does not use are compiled out
+  struct RtVariantKey
+  {
+    uint32_t recursionDepth{2};  // maxPipelineRayRecursionDepth, the shader allows recursionDepth - 2 bounces
+    int32_t  lightType{-1};      // Light type compiled into the shader, -1 reads pcRay.lightType
+    bool     shadows{true};      // Trace shadow rays
+    bool     textures{true};     // Sample material textures
+    bool     pathTracing{false}; // Path tracing loop in the raygen shader, recursion depth 1
+    bool     operator<(const RtVariantKey& o) const
+    {
+      return std::tie(recursionDepth, lightType, shadows, textures, pathTracing)
+             < std::tie(o.recursionDepth, o.lightType, o.shadows, o.textures, o.pathTracing);
+    }
+    bool operator==(const RtVariantKey& o) const { return !(*this < o) && !(o < *this); }
+  };
+  struct RtPipelineVariant
+  {
+    VkPipeline                        pipeline{VK_NULL_HANDLE};
+    std::unique_ptr<nvvk::SBTWrapper> sbt;
+  };
+  RtVariantKey currentRtVariantKey() const;
+  void         createRtPipelineVariants(const std::vector<RtVariantKey>& keys);
+  void         createRtSbt(RtPipelineVariant& variant);
+  void         classifyHitGroup(const ModelLoader& loader, ObjModel& model) const;
+  void         setInstanceObjectData(VkAccelerationStructureInstanceKHR& rayInst, uint32_t objIndex) const;
+
+  std::map<RtVariantKey, RtPipelineVariant>    m_rtVariants;
+  std::vector<VkPipelineShaderStageCreateInfo> m_rtStages;    // Shader modules shared by all variants
+  std::vector<VkShaderModule>                  m_rtPathModules;  // Per stage replacement in path tracing variants, null keeps m_rtStages
+  std::vector<uint32_t>                        m_rtPrecompileBounces;  // Max bounce settings compiled up front with the current one
+  bool                                         m_rtSpecializeLight{true};  // One variant per light type instead of a runtime branch
+  bool                                         m_sceneTextured{false};     // A loaded material references a texture
+  bool                                         m_sbtDirty{false};          // Models changed, the per-model hit records are stale
+  float                                        m_emissiveThreshold{1.0f};  // Brightest emission channel of a light material
 
   std::vector<VkAccelerationStructureInstanceKHR>    m_tlas;
-  std::vector<nvvk::RaytracingBuilderKHR::BlasInput> m_blas;
+  std::vector<BlasInput>                             m_blas;
 
   // Push constant for ray tracer
   PushConstantRay m_pcRay{};
 
+  // #Settings - quality and frame time trade-offs, e.g. from the Hydra render settings
+  struct RenderSettings
+  {
+    uint32_t spp{1};                       // Samples per pixel traced each frame
+    uint32_t maxBounces{2};                // Reflection bounces after the primary hit
+    uint32_t rrBounceOffset{3};            // Bounces before Russian roulette may end a path
+    float    rrInvMinTermProb{0.95f};      // Upper bound of the probability to continue a path
+    bool     progressiveAccumulation{true};  // Average the frames of a static view
+    bool     jitteredSampling{true};         // Random subpixel positions instead of the pixel center
+    bool     shadows{true};                  // Trace shadow rays toward the light
+    bool     pathTracing{false};             // Iterative path tracing with next-event estimation instead of Whitted-style shading
+    bool operator==(const RenderSettings& o) const
+    {
+      return spp == o.spp && maxBounces == o.maxBounces && rrBounceOffset == o.rrBounceOffset && rrInvMinTermProb == o.rrInvMinTermProb
+             && progressiveAccumulation == o.progressiveAccumulation && jitteredSampling == o.jitteredSampling && shadows == o.shadows
+             && pathTracing == o.pathTracing;
+    }
+  };
+  void setRenderSettings(const RenderSettings& settings);
+  const RenderSettings& getRenderSettings() const { return m_renderSettings; }
+
+  RenderSettings m_renderSettings;
+
+  // #Accumulation - progressive refinement while the camera, scene and lights do not change
+  struct AccumulationSettings
+  {
+    uint32_t maxSamples{256};           // Converged after this many samples per pixel, 0: no sample limit
+    uint32_t minSamples{16};            // Samples before the variance test may report convergence
+    float    varianceThreshold{0.01f};  // Relative standard error of a converged pixel, 0 disables the test
+    bool     adaptive{true};            // After minSamples, spend samples only on tiles above varianceThreshold
+    uint32_t maxSamplesPerFrame{16};    // Most samples per pixel an adaptive tile traces in one frame
+  };
+  void     createAccumulationBuffer();
+  void     resetAccumulation();
+  void     updateAccumulation();
+  bool     isConverged() const;
+  bool     isAdaptive() const;
+  uint32_t getAccumulatedSamples() const { return m_accumFrame * std::max(m_renderSettings.spp, 1u); }
+  uint32_t getActiveTiles() const { return m_activeTiles; }
+  void     recordAdaptivePass(const VkCommandBuffer& cmdBuf, uint32_t warmupSamples);
+
+  AccumulationSettings m_accumSettings;
+  nvvk::Buffer         m_accumBuffer;                 // Per-pixel sums of the samples (eAccum)
+  nvvk::Buffer         m_accumStats;                  // Host-visible AccumStats of the last frame (eAccumStats)
+  AccumStats*          m_accumStatsMapped{nullptr};
+  uint32_t             m_accumFrame{0};               // Samples accumulated per pixel
+  uint32_t             m_unconvergedPixels{~0u};      // Read back after the last traced frame
+  glm::mat4            m_accumViewProj{0.0f};         // Camera the samples were accumulated with
+  bool                 m_traced{false};               // The last raytrace() dispatched rays (not converged)
+  nvvk::Buffer         m_adaptiveTiles;               // AdaptiveTile per ADAPTIVE_TILE_SIZE^2 pixels (eAdaptiveTiles)
+  uint32_t             m_adaptiveTileCount{0};
+  bool                 m_adaptiveTilesClear{true};    // Zero m_adaptiveTiles before the next trace (resetAccumulation)
+  uint32_t             m_activeTiles{0};              // Tiles still sampling after the last traced frame
+  VkPipelineLayout     m_adaptivePipelineLayout{VK_NULL_HANDLE};
+  VkPipeline           m_adaptivePipeline{VK_NULL_HANDLE};  // adaptive_sampling.comp
+
   // #VK_animation
   void animationInstances(float time);
   void animationObject(float time);
@@ -163,6 +339,7 @@ public:
   VkBuildAccelerationStructureFlagsKHR m_rtFlags;
 
   void saveOffscreenColorToFile(const char* filename);
+  void readOffscreenRegion(const VkRect2D& region, std::vector<glm::vec4>& pixels);
   GLuint getOpenGLFrame() { return m_rtOutputGL.oglId; }
 #if ENABLE_GL_VK_CONVERSION
   void createOutputImage();
@@ -1,13 +1,16 @@
 #include "nvh/cameramanipulator.hpp"
 #include "nvh/fileoperations.hpp"
+#include "nvh/nvprint.hpp"
 #include "nvvk/commands_vk.hpp"
 #include <cassert>
 #include <array>
 #include "ray_trace_app.hpp"
+#include "embedded_spirv.hpp"
 
 // opengl上下文
 #include "nvgl/contextwindow_gl.hpp"
 #include <algorithm>
+#include <cstdlib>
 
 #include "obj_loader.h"
 
@@ -52,11 +55,15 @@ void RayTraceApp::setupContext()
 {
   NVPSystem system("raytrace_vulkan_headless");
   std::string currentDir = fs::current_path().string();
+  // 搜索路径只用于演示场景的模型和纹理；着色器嵌入在库中，与工作目录无关
   defaultSearchPaths = {
       NVPSystem::exePath() + PROJECT_RELDIRECTORY,
       NVPSystem::exePath() + PROJECT_RELDIRECTORY "/..",
       currentDir + "/headless",
   };
+  // 设置环境变量 HEADLESS_SPIRV_DIR 时从该目录读取 spv 文件，覆盖嵌入的着色器
+  if(const char* spirvDir = std::getenv("HEADLESS_SPIRV_DIR"))
+    spirv::setOverrideDirectory(spirvDir);
 
   nvvk::ContextCreateInfo contextInfo;
   contextInfo.setVersion(1, 2);
@@ -100,6 +107,14 @@ void RayTraceApp::setupHelloVulkan()
   createInfo.physicalDevice = m_vkctx.m_physicalDevice;
   createInfo.queueIndices   = {m_vkctx.m_queueGCT.familyIndex};
   createInfo.size           = {uint32_t(m_width), uint32_t(m_height)};
+  // 管线缓存按设备和驱动版本保存在临时目录，渲染进程冷启动时不必重新编译光追管线
+  createInfo.pipelineCacheDirectory = (fs::temp_directory_path() / "raytrace_vulkan_headless" / "pipeline_cache").string();
+  // 压缩后的静态BLAS缓存在临时目录，同一资产库再次启动时直接反序列化
+  m_helloVk.m_asCacheDirectory = (fs::temp_directory_path() / "raytrace_vulkan_headless" / "blas_cache").string();
+  // 多材质mesh（USD GeomSubsets）每个材质一个BLAS geometry，命中时按geometry取材质
+  m_helloVk.m_splitByMaterial = true;
+  // Hydra的 max-bounces 默认为 13，该变体与默认设置的变体一起并行编译
+  m_helloVk.m_rtPrecompileBounces = {13};
   m_helloVk.create(createInfo);
 }
 
@@ -111,6 +126,7 @@ void RayTraceApp::createBVH()
   m_helloVk.createGraphicsPipeline();
   m_helloVk.createUniformBuffer();
   m_helloVk.createObjDescriptionBuffer();
+  m_helloVk.createTextureInfoBuffer();
   m_helloVk.updateDescriptorSet();
 
   // 光线追踪相关
@@ -127,6 +143,9 @@ void RayTraceApp::createBVH()
 
 void RayTraceApp::render()
 {
+  // 本帧所有实例/BLAS修改合并为一次TLAS更新（或实例增删时的一次重建）
+  m_helloVk.flushTlas();
+
   auto                   curFrame = m_helloVk.getCurFrame();
   const VkCommandBuffer& cmdBuf   = m_helloVk.getCommandBuffers()[curFrame];
 
@@ -141,10 +160,100 @@ void RayTraceApp::render()
   clearValues[0].color                   = {{clearColor[0], clearColor[1], clearColor[2], clearColor[3]}};
   clearValues[1].depthStencil            = {1.0f, 0};
 
-  m_helloVk.raytrace(cmdBuf, clearColor);
+  const VkExtent2D size = m_helloVk.getSize();
+  float            traceMs{0.0f};
+  if(m_tileSettings.tileSize > 0 && uint64_t(size.width) * size.height > m_tileSettings.minImagePixels)
+  {
+    traceMs = renderTiles(cmdBuf, clearColor);
+  }
+  else
+  {
+    m_helloVk.raytrace(cmdBuf, clearColor);
+    vkEndCommandBuffer(cmdBuf);
+    m_helloVk.submitFrame();
+    traceMs = m_helloVk.getTraceTimeMs();
+  }
+
+  // 帧完成后读取收敛统计
+  m_helloVk.updateAccumulation();
+  // 帧完成后根据feedback流式加载纹理
+  m_helloVk.updateTextureStreaming();
+  // 分摊执行变形BLAS的排队重建
+  m_helloVk.updateAccelerationStructures();
+
+  // 光追平均耗时，用于比较BLAS构建标志/压缩的效果
+  m_traceTimeSum += traceMs;
+  if(++m_frameCount % kTraceLogInterval == 0)
+  {
+    const BlasFrameCounters& counters = m_helloVk.m_blasBuilder.getFrameCounters();
+    const TlasBuilder&       tlas     = m_helloVk.m_tlasBuilder;
+    LOGI("Trace time: %.3f ms (average of %u frames), last frame BLAS refits %u, rebuilds %u, pending %u\n",
+         m_traceTimeSum / kTraceLogInterval, kTraceLogInterval, counters.refits, counters.rebuilds, counters.pendingRebuilds);
+    LOGI("Last TLAS update: %.3f ms, %u of %u instances uploaded\n", tlas.getUpdateTimeMs(), tlas.getDeltaCount(), tlas.size());
+    if(m_helloVk.isAdaptive())
+      LOGI("Accumulated frames: %u, adaptive tiles still sampling: %u of %u%s\n", m_helloVk.m_accumFrame,
+           m_helloVk.getActiveTiles(), m_helloVk.m_adaptiveTileCount, m_helloVk.isConverged() ? " (converged)" : "");
+    else
+      LOGI("Accumulated samples: %u%s\n", m_helloVk.getAccumulatedSamples(), m_helloVk.isConverged() ? " (converged)" : "");
+    m_traceTimeSum = 0.0;
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// 按行优先把图像切块，每批块录制到同一个命令缓冲中提交并等待完成
+// 第一批包含 render() 已录制的uniform更新，最后一批之后执行 endRaytrace（累积帧数、自适应采样pass）
+// 所有批次共用本帧的push constant，结果与整幅图像一次追踪相同
+float RayTraceApp::renderTiles(const VkCommandBuffer& cmdBuf, const glm::vec4& clearColor)
+{
+  if(!m_helloVk.beginRaytrace(clearColor))
+  {
+    vkEndCommandBuffer(cmdBuf);
+    m_helloVk.submitFrame();
+    return 0.0f;
+  }
+
+  const VkExtent2D      size     = m_helloVk.getSize();
+  const uint32_t        tileSize = m_tileSettings.tileSize;
+  std::vector<VkRect2D> tiles;
+  for(uint32_t y = 0; y < size.height; y += tileSize)
+  {
+    for(uint32_t x = 0; x < size.width; x += tileSize)
+      tiles.push_back({{int32_t(x), int32_t(y)}, {std::min(tileSize, size.width - x), std::min(tileSize, size.height - y)}});
+  }
 
-  vkEndCommandBuffer(cmdBuf);
-  m_helloVk.submitFrame();
+  VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  float  traceMs{0.0f};
+  size_t next = 0;
+  while(next < tiles.size())
+  {
+    if(next > 0)
+      vkBeginCommandBuffer(cmdBuf, &beginInfo);
+
+    const size_t          count = std::min<size_t>(m_tilesPerSubmit, tiles.size() - next);
+    std::vector<VkRect2D> batch(tiles.begin() + next, tiles.begin() + next + count);
+    m_helloVk.traceRegions(cmdBuf, batch);
+    next += count;
+    if(next == tiles.size())
+      m_helloVk.endRaytrace(cmdBuf);
+
+    vkEndCommandBuffer(cmdBuf);
+    m_helloVk.submitFrame();
+
+    // 按本批每块的平均耗时估计预算内能提交的块数
+    const float batchMs = m_helloVk.getTraceTimeMs();
+    traceMs += batchMs;
+    if(batchMs > 0.0f)
+    {
+      const float perTile = batchMs / float(count);
+      m_tilesPerSubmit = uint32_t(std::clamp(m_tileSettings.submitBudgetMs / perTile, 1.0f, float(tiles.size())));
+    }
+
+    if(m_tileCallback)
+      m_tileCallback(batch);
+  }
+  return traceMs;
 }
 
 void RayTraceApp::saveFrame(std::string outputImagePath)
@@ -196,6 +305,8 @@ void RayTraceApp::loadScene()
   ObjLoader sphereLoader;
   sphereLoader.loadModel(nvh::findFile("media/scenes/sphere.obj", defaultSearchPaths, true));
   m_helloVk.loadModel(sphereLoader);
+  // 球体顶点由计算着色器做动画，BLAS需要refit
+  m_helloVk.m_objModel.back().usage = BlasUsage::eDeformable;
 
   // 
   m_startTime = std::chrono::system_clock::now();
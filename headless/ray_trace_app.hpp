@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "nvpsystem.hpp"
@@ -39,6 +40,20 @@ public:
   // save local png file
   void saveFrame(std::string outputImagePath = "headless.png");
 
+  // 分块渲染：图像像素数超过 minImagePixels 时，一帧拆成多个 tileSize 的块分批提交
+  // 每次提交的块数按实测耗时调整，使单次提交的GPU耗时不超过 submitBudgetMs，避免长时间占用队列触发驱动看门狗（TDR）
+  struct TileSettings
+  {
+    uint32_t tileSize{1024};
+    uint32_t minImagePixels{3840u * 2160u};
+    float    submitBudgetMs{200.0f};
+  };
+  void                setTileSettings(const TileSettings& settings) { m_tileSettings = settings; }
+  const TileSettings& getTileSettings() const { return m_tileSettings; }
+  // 每批块提交完成后调用，参数为刚完成的块；回调中可以用 getVulkan().readOffscreenRegion 读取预览
+  using TileCallback = std::function<void(const std::vector<VkRect2D>& finished)>;
+  void setTileCallback(TileCallback callback) { m_tileCallback = std::move(callback); }
+
   // 
   HelloVulkan& getVulkan() { return m_helloVk; };
 
@@ -58,8 +73,20 @@ private:
   void setupContext();
   void setupHelloVulkan();
 
+  // 分块渲染一帧，cmdBuf 已开始录制；返回所有批次的光追耗时之和（毫秒）
+  float renderTiles(const VkCommandBuffer& cmdBuf, const glm::vec4& clearColor);
+
   // for compute animation,test on the Specified model file
   std::chrono::system_clock::time_point m_startTime;
 
   bool _cleaned = false;
+
+  // 光追耗时统计（每 kTraceLogInterval 帧输出一次平均值）
+  static constexpr uint32_t kTraceLogInterval = 100;
+  uint32_t                  m_frameCount{0};
+  double                    m_traceTimeSum{0.0};
+
+  TileSettings m_tileSettings;
+  TileCallback m_tileCallback;
+  uint32_t     m_tilesPerSubmit{1};  // 由上一次提交的实测耗时估计，跨帧沿用
 };
\ No newline at end of file
@@ -28,6 +28,7 @@ using vec3 = glm::vec3;
 using vec4 = glm::vec4;
 using mat4 = glm::mat4;
 using uint = unsigned int;
+using uvec2 = glm::uvec2;
 #endif
 
 // clang-format off
@@ -42,15 +43,32 @@ using uint = unsigned int;
 START_BINDING(SceneBindings)
   eGlobals  = 0,  // Global uniform containing camera matrices
   eObjDescs = 1,  // Access to the object descriptions
-  eTextures = 2   // Access to textures
+  eTextures = 2,  // Access to textures
+  eTexInfos = 3   // Per-texture streaming state and mip feedback
 END_BINDING();
 
 START_BINDING(RtxBindings)
-  eTlas     = 0,  // Top-level acceleration structure
-  eOutImage = 1   // Ray tracer output image
+  eTlas       = 0,  // Top-level acceleration structure
+  eOutImage   = 1,  // Ray tracer output image
+  eAccum      = 2,  // Per-pixel sums of the accumulated samples
+  eAccumStats = 3,  // Convergence statistics of the last frame
+  eAdaptiveTiles = 4  // Per-tile error and sample counts of adaptive sampling
+END_BINDING();
+
+START_BINDING(HitGroups)
+  eHitOpaque      = 0,  // Diffuse and textured materials: closest hit only
+  eHitTransparent = 1,  // Alpha-tested or dissolve < 1 geometry: closest hit + any-hit
+  eHitEmissive    = 2,  // A single emissive material: returns the emission, no shading rays
+  eHitGroupCount  = 3
 END_BINDING();
 // clang-format on
 
+// Adaptive sampling decides the sample count per square tile of pixels
+#define ADAPTIVE_TILE_SIZE 16
+
+// Alpha-tested materials: texture alpha below the cutoff is a hole (raytrace.rahit, tex::alphaCoverage)
+#define ALPHA_CUTOFF 0.5
+
 // Information of a obj model when referenced in a shader
 struct ObjDesc
 {
@@ -59,6 +77,31 @@ struct ObjDesc
   uint64_t indexAddress;         // Address of the index buffer
   uint64_t materialAddress;      // Address of the material buffer
   uint64_t materialIndexAddress; // Address of the triangle material index buffer
+  uint64_t geometryAddress;      // Address of the GeometryDesc array, indexed by gl_GeometryIndexEXT
+};
+
+// One geometry of a BLAS: a run of triangles sharing a material when the mesh is split by material
+struct GeometryDesc
+{
+  int  materialIndex;   // Material of all triangles of the geometry, -1: read the triangle material index buffer
+  uint primitiveOffset; // First triangle of the geometry in the index buffer (gl_PrimitiveID restarts at 0)
+};
+
+// Data after the hit group handle of an SBT record, read with shaderRecordEXT
+// One record per model, the TLAS instances of a model use the model index as SBT record offset
+struct HitRecord
+{
+  vec3 emission;      // Radiance of the material (eHitEmissive)
+  int  materialIndex; // Material of every triangle when the model has only one, -1 otherwise
+};
+
+// Streaming state of a texture, written by the host and by the closest hit shader (feedback)
+struct TextureInfo
+{
+  uint width;        // Resolution of the full mip 0
+  uint height;
+  uint residentMip;  // Finest resident mip, level 0 of the bound image
+  uint requestedMip; // Finest mip requested by the tracer this frame, 0xFFFFFFFF if not sampled
 };
 
 // Uniform buffer set at each frame
@@ -86,6 +129,54 @@ struct PushConstantRay
   vec3  lightPosition;
   float lightIntensity;
   int   lightType;
+  float pixelSpreadAngle; // Ray cone spread per pixel, used to select the texture mip
+  int   textureFeedback;  // 1: write requested mips to TextureInfo for streaming
+  uint  frameIndex;       // Samples already accumulated per pixel, 0 restarts the accumulation
+  float varianceThreshold; // Relative standard error of a converged pixel, 0 disables the test
+  uint  samplesPerPixel;  // Samples traced per pixel each frame
+  uint  maxBounces;       // Reflection bounces after the primary hit, bounded by the recursion depth unless path tracing
+  uint  rrBounceOffset;   // Bounces before Russian roulette may terminate a path
+  float rrInvMinTermProb; // Upper bound of the continuation probability of Russian roulette
+  int   jitteredSampling; // 1: random subpixel positions, 0: pixel center
+  uvec2 tileOffset;       // First pixel of the region covered by this trace call (8-byte aligned offset)
+  uvec2 imageSize;        // Size of the whole output image, the launch size is the region size
+  uint  adaptiveMode;     // 0: uniform, 1: uniform and measure the tile error (warm-up), 2: trace the tile sample counts
+};
+
+// Convergence statistics written by the ray generation shader, read back by the host after the frame
+struct AccumStats
+{
+  uint unconvergedPixels; // Pixels whose relative error is still above varianceThreshold
+  uint activeTiles;       // Tiles that trace more samples in the next frame (adaptive sampling)
+};
+struct AdaptiveTile
+{
+  uint maxError;    // floatBitsToUint of the largest relative error in the tile, reset every frame
+  uint samples;     // Samples per pixel accumulated in the tile
+  uint nextSamples; // Samples per pixel to trace in the next frame, 0: the tile stopped
+};
+struct PushConstantAdaptive
+{
+  uint64_t tileAddress;        // AdaptiveTile array, row-major in tiles
+  uint64_t statsAddress;       // AccumStats, receives the active tile count
+  uint     tileCount;
+  uint     warmupSamples;      // Samples per pixel after a uniform frame, 0 after an adaptive frame
+  uint     minSamplesPerFrame; // Lower bound of nextSamples of an active tile
+  uint     maxSamplesPerFrame; // Upper bound of nextSamples
+  uint     maxSamples;         // A tile stops at this many samples per pixel
+  float    varianceThreshold;  // A tile stops once its largest relative error is below this
+};
+
+// Push constant of the TLAS instance compute shaders (tlas_scatter.comp, tlas_animate.comp)
+struct PushConstantTlas
+{
+  mat4     base;            // Transform the animated instances are placed relative to (animate)
+  uint64_t instanceAddress; // Device-resident VkAccelerationStructureInstanceKHR array
+  uint64_t deltaAddress;    // Changed instances to write into the array (scatter)
+  uint     first;           // First instance to write (animate)
+  uint     count;           // Number of deltas, or of animated instances
+  float    angleOffset;     // Rotation of the first animated instance around Y, in radians (animate)
+  float    radius;          // Distance of the animated instances from the circle center (animate)
 };
 
 struct Vertex // See ObjLoader, copy of VertexObj, could be compressed for device
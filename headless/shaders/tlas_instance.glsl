@@ -0,0 +1,21 @@
+// Layout of VkAccelerationStructureInstanceKHR, as read by the acceleration structure build
+struct AccelInstance
+{
+  vec4     transform[3];      // Row-major 3x4 object-to-world matrix
+  uint     customIndexMask;   // instanceCustomIndex:24, mask:8
+  uint     sbtOffsetFlags;    // instanceShaderBindingTableRecordOffset:24, flags:8
+  uint64_t blasReference;     // Device address of the BLAS
+};
+
+// One changed instance uploaded by the host, see TlasBuilder::update
+struct InstanceDelta
+{
+  uint          index;  // Slot in the instance array
+  uint          pad0;
+  uint          pad1;
+  uint          pad2;
+  AccelInstance instance;
+};
+
+layout(buffer_reference, scalar) buffer AccelInstances { AccelInstance i[]; };
+layout(buffer_reference, scalar) readonly buffer InstanceDeltas { InstanceDelta d[]; };
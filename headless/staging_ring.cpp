@@ -0,0 +1,258 @@
+#include "staging_ring.hpp"
+#include "texture_loader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// 拷贝源偏移对齐（满足buffer拷贝以及所有格式的 bufferOffset 要求）
+static constexpr VkDeviceSize kAlignment = 16;
+
+static VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a)
+{
+  return (v + a - 1) / a * a;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void StagingRing::init(VkDevice device, uint32_t queueFamily, nvvk::ResourceAllocator* alloc, VkDeviceSize budget, uint32_t segments)
+{
+  m_device       = device;
+  m_queueFamily  = queueFamily;
+  m_alloc        = alloc;
+  m_budget       = budget;
+  m_segmentCount = std::max(segments, 2u);
+  vkGetDeviceQueue(m_device, m_queueFamily, 0, &m_queue);
+
+  VkCommandPoolCreateInfo poolInfo{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  poolInfo.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  poolInfo.queueFamilyIndex = m_queueFamily;
+  vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_cmdPool);
+
+  create();
+}
+
+void StagingRing::deinit()
+{
+  if(m_device == VK_NULL_HANDLE)
+    return;
+  flush();
+  destroy();
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+  m_cmdPool = VK_NULL_HANDLE;
+  m_device  = VK_NULL_HANDLE;
+}
+
+void StagingRing::setBudget(VkDeviceSize budget)
+{
+  if(budget == m_budget)
+    return;
+  flush();
+  destroy();
+  m_budget = budget;
+  create();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 分配环形buffer和每段的命令缓冲/fence
+void StagingRing::create()
+{
+  m_segmentSize = std::max<VkDeviceSize>(alignUp(m_budget / m_segmentCount, kAlignment), 64 * 1024);
+
+  m_buffer = m_alloc->createBuffer(m_segmentSize * m_segmentCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  m_mapped = static_cast<uint8_t*>(m_alloc->map(m_buffer));
+
+  m_segments.resize(m_segmentCount);
+  std::vector<VkCommandBuffer> cmds(m_segmentCount);
+  VkCommandBufferAllocateInfo  allocInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  allocInfo.commandPool        = m_cmdPool;
+  allocInfo.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = m_segmentCount;
+  vkAllocateCommandBuffers(m_device, &allocInfo, cmds.data());
+
+  VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for(uint32_t i = 0; i < m_segmentCount; i++)
+  {
+    m_segments[i].cmd = cmds[i];
+    vkCreateFence(m_device, &fenceInfo, nullptr, &m_segments[i].fence);
+  }
+  m_current = 0;
+  m_used    = 0;
+}
+
+void StagingRing::destroy()
+{
+  for(auto& s : m_segments)
+  {
+    vkDestroyFence(m_device, s.fence, nullptr);
+    vkFreeCommandBuffers(m_device, m_cmdPool, 1, &s.cmd);
+  }
+  m_segments.clear();
+
+  if(m_mapped)
+  {
+    m_alloc->unmap(m_buffer);
+    m_mapped = nullptr;
+  }
+  m_alloc->destroy(m_buffer);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 当前段的命令缓冲；段空闲时先等待它上一次的提交完成再开始录制
+VkCommandBuffer StagingRing::cmd()
+{
+  Segment& seg = m_segments[m_current];
+  m_pending    = true;
+  if(!seg.recording)
+  {
+    vkWaitForFences(m_device, 1, &seg.fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(m_device, 1, &seg.fence);
+    vkResetCommandBuffer(seg.cmd, 0);
+
+    VkCommandBufferBeginInfo beginInfo{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(seg.cmd, &beginInfo);
+    seg.recording = true;
+  }
+  return seg.cmd;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 提交当前段（不等待），切换到下一段
+void StagingRing::submitCurrent()
+{
+  Segment& seg = m_segments[m_current];
+  if(seg.recording)
+  {
+    vkEndCommandBuffer(seg.cmd);
+    VkSubmitInfo submit{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers    = &seg.cmd;
+    vkQueueSubmit(m_queue, 1, &submit, seg.fence);
+    seg.recording = false;
+    m_submitCount++;
+  }
+  m_current = (m_current + 1) % m_segmentCount;
+  m_used    = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 在当前段预留空间：至少 minSize 字节，至多 wanted 字节
+VkDeviceSize StagingRing::reserve(VkDeviceSize wanted, VkDeviceSize minSize, VkDeviceSize& ringOffset)
+{
+  VkDeviceSize start = alignUp(m_used, kAlignment);
+  if(start + minSize > m_segmentSize)
+  {
+    submitCurrent();
+    start = 0;
+  }
+  cmd();  // 确保该段的上一次提交已经完成，内存可以覆盖
+
+  VkDeviceSize size = std::min(wanted, m_segmentSize - start);
+  ringOffset        = VkDeviceSize(m_current) * m_segmentSize + start;
+  m_used            = start + size;
+  return size;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void StagingRing::uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+  auto         src  = static_cast<const uint8_t*>(data);
+  VkDeviceSize done = 0;
+  while(done < size)
+  {
+    VkDeviceSize ringOffset;
+    VkDeviceSize chunk = reserve(size - done, std::min<VkDeviceSize>(size - done, kAlignment), ringOffset);
+    memcpy(m_mapped + ringOffset, src + done, chunk);
+
+    VkBufferCopy region{ringOffset, dstOffset + done, chunk};
+    vkCmdCopyBuffer(cmd(), m_buffer.buffer, dst, 1, &region);
+    done += chunk;
+  }
+  m_uploadedBytes += size;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 按块行拆分：能放下整行时一次拷贝多行，单行超过一段时再按列拆分
+void StagingRing::uploadImage(VkImage                         dst,
+                              const VkImageSubresourceLayers& subresource,
+                              const VkExtent3D&               extent,
+                              VkFormat                        format,
+                              const void*                     data,
+                              VkDeviceSize                    size)
+{
+  const uint32_t     blockDim   = tex::isBlockCompressed(format) ? 4 : 1;
+  const uint32_t     blocksX    = (extent.width + blockDim - 1) / blockDim;
+  const uint32_t     blocksY    = (extent.height + blockDim - 1) / blockDim;
+  const VkDeviceSize blockBytes = size / (VkDeviceSize(blocksX) * blocksY);
+  const VkDeviceSize rowBytes   = blockBytes * blocksX;
+  auto               src        = static_cast<const uint8_t*>(data);
+
+  uint32_t row = 0;
+  while(row < blocksY)
+  {
+    VkDeviceSize ringOffset;
+    if(rowBytes <= m_segmentSize)
+    {
+      // 整行
+      VkDeviceSize chunk = reserve(rowBytes * (blocksY - row), rowBytes, ringOffset);
+      uint32_t     rows  = static_cast<uint32_t>(chunk / rowBytes);
+      memcpy(m_mapped + ringOffset, src + row * rowBytes, rows * rowBytes);
+      m_used = ringOffset - VkDeviceSize(m_current) * m_segmentSize + rows * rowBytes;
+
+      VkBufferImageCopy region{};
+      region.bufferOffset     = ringOffset;
+      region.imageSubresource = subresource;
+      region.imageOffset      = {0, int32_t(row * blockDim), 0};
+      region.imageExtent      = {extent.width, std::min(rows * blockDim, extent.height - row * blockDim), 1};
+      vkCmdCopyBufferToImage(cmd(), m_buffer.buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+      row += rows;
+    }
+    else
+    {
+      // 单行超过一段：按列拆分
+      uint32_t col = 0;
+      while(col < blocksX)
+      {
+        VkDeviceSize chunk = reserve(blockBytes * (blocksX - col), blockBytes, ringOffset);
+        uint32_t     cols  = static_cast<uint32_t>(chunk / blockBytes);
+        memcpy(m_mapped + ringOffset, src + row * rowBytes + col * blockBytes, cols * blockBytes);
+        m_used = ringOffset - VkDeviceSize(m_current) * m_segmentSize + cols * blockBytes;
+
+        VkBufferImageCopy region{};
+        region.bufferOffset     = ringOffset;
+        region.imageSubresource = subresource;
+        region.imageOffset      = {int32_t(col * blockDim), int32_t(row * blockDim), 0};
+        region.imageExtent      = {std::min(cols * blockDim, extent.width - col * blockDim),
+                                   std::min(blockDim, extent.height - row * blockDim), 1};
+        vkCmdCopyBufferToImage(cmd(), m_buffer.buffer, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+        col += cols;
+      }
+      row++;
+    }
+  }
+  m_uploadedBytes += size;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 提交并等待所有段；最后加一个屏障，使拷贝结果对后续所有命令可见
+void StagingRing::flush()
+{
+  if(!m_pending)
+    return;
+
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier(cmd(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0,
+                       nullptr, 0, nullptr);
+  submitCurrent();
+
+  std::vector<VkFence> fences;
+  for(auto& s : m_segments)
+    fences.push_back(s.fence);
+  vkWaitForFences(m_device, static_cast<uint32_t>(fences.size()), fences.data(), VK_TRUE, UINT64_MAX);
+  m_pending = false;
+}
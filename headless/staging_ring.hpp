@@ -0,0 +1,73 @@
+#pragma once
+
+#include "nvvk/resourceallocator_vk.hpp"
+
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// 固定大小、持久映射的上传环形缓冲（staging ring）
+// - 整个环按预算大小分配一次，分成若干段，每段有自己的命令缓冲和fence
+// - 大的上传被拆成多块：CPU向下一段memcpy的同时，GPU在执行上一段的拷贝
+// - 不论资源多大，host可见的staging内存峰值都不超过预算
+//
+// 上传命令按提交顺序在同一个队列上执行；需要在拷贝前后记录屏障时，用 cmd() 取当前段的命令缓冲
+//
+class StagingRing
+{
+public:
+  void init(VkDevice device, uint32_t queueFamily, nvvk::ResourceAllocator* alloc, VkDeviceSize budget = 64ull << 20, uint32_t segments = 4);
+  void deinit();
+
+  // 修改预算（会先flush并重新分配）
+  void         setBudget(VkDeviceSize budget);
+  VkDeviceSize getBudget() const { return m_budget; }
+
+  // 上传到buffer，dst需要 TRANSFER_DST 用途
+  void uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+  // 上传一层2D image（需处于 TRANSFER_DST_OPTIMAL），按行（压缩格式按块行）拆分
+  void uploadImage(VkImage dst, const VkImageSubresourceLayers& subresource, const VkExtent3D& extent, VkFormat format, const void* data, VkDeviceSize size);
+
+  // 当前段正在录制的命令缓冲，用于记录布局转换等屏障
+  VkCommandBuffer cmd();
+
+  // 提交剩余的拷贝并等待所有段完成，之后上传的数据对所有后续命令可见
+  void flush();
+
+  // 统计：累计上传的字节数和提交的段数
+  VkDeviceSize getUploadedBytes() const { return m_uploadedBytes; }
+  uint32_t     getSubmitCount() const { return m_submitCount; }
+
+private:
+  struct Segment
+  {
+    VkCommandBuffer cmd{VK_NULL_HANDLE};
+    VkFence         fence{VK_NULL_HANDLE};
+    bool            recording{false};
+  };
+
+  void     create();
+  void     destroy();
+  // 在当前段中预留空间，返回可用字节数（不超过 wanted），必要时提交当前段并切换到下一段
+  VkDeviceSize reserve(VkDeviceSize wanted, VkDeviceSize minSize, VkDeviceSize& ringOffset);
+  void     submitCurrent();
+
+  VkDevice                 m_device{VK_NULL_HANDLE};
+  VkQueue                  m_queue{VK_NULL_HANDLE};
+  uint32_t                 m_queueFamily{0};
+  nvvk::ResourceAllocator* m_alloc{nullptr};
+
+  VkDeviceSize m_budget{0};
+  VkDeviceSize m_segmentSize{0};
+  uint32_t     m_segmentCount{0};
+
+  nvvk::Buffer         m_buffer;
+  uint8_t*             m_mapped{nullptr};
+  VkCommandPool        m_cmdPool{VK_NULL_HANDLE};
+  std::vector<Segment> m_segments;
+  uint32_t             m_current{0};
+  VkDeviceSize         m_used{0};  // 当前段已使用的字节
+  bool                 m_pending{false};  // 上次flush之后是否录制过命令
+
+  VkDeviceSize m_uploadedBytes{0};
+  uint32_t     m_submitCount{0};
+};
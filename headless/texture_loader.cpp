@@ -0,0 +1,751 @@
+#include "texture_loader.hpp"
+#include "nvh/nvprint.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace tex {
+
+namespace {
+
+// sRGB <-> 线性 转换（用于mip滤波）
+float srgbToLinear(uint8_t c)
+{
+  float v = c / 255.0f;
+  return v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+}
+
+uint8_t linearToSrgb(float v)
+{
+  v = std::clamp(v, 0.0f, 1.0f);
+  v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(v * 255.0f + 0.5f);
+}
+
+const std::array<float, 256>& srgbTable()
+{
+  static const std::array<float, 256> table = [] {
+    std::array<float, 256> t{};
+    for(int i = 0; i < 256; i++)
+      t[i] = srgbToLinear(static_cast<uint8_t>(i));
+    return t;
+  }();
+  return table;
+}
+
+// 线性 -> sRGB 查找表（线性值量化为14位），避免在mip滤波中逐像素调用pow
+constexpr int kLinearLutSize = 1 << 14;
+
+const std::array<uint8_t, kLinearLutSize>& linearTable()
+{
+  static const std::array<uint8_t, kLinearLutSize> table = [] {
+    std::array<uint8_t, kLinearLutSize> t{};
+    for(int i = 0; i < kLinearLutSize; i++)
+      t[i] = linearToSrgb((i + 0.5f) / kLinearLutSize);
+    return t;
+  }();
+  return table;
+}
+
+// 把 [0, rows) 按行分给多个线程；像素很少时直接在当前线程执行
+template <typename F>
+void parallelRows(uint32_t rows, uint32_t pixelsPerRow, uint32_t threads, F&& fn)
+{
+  if(threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, rows);
+  if(threads <= 1 || size_t(rows) * pixelsPerRow < 64 * 1024)
+  {
+    fn(0u, rows);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  uint32_t                 step = (rows + threads - 1) / threads;
+  for(uint32_t begin = 0; begin < rows; begin += step)
+    workers.emplace_back(fn, begin, std::min(rows, begin + step));
+  for(auto& w : workers)
+    w.join();
+}
+
+// 2x2盒式滤波缩小一层，srgb 为 true 时RGB在线性空间中平均
+// 内部列不做越界判断，整型路径可以被编译器向量化；奇数宽高的最后一列/行重复边缘像素
+void downsample2x(const TextureMip& src, TextureMip& dst, bool srgb, uint32_t threads)
+{
+  dst.width  = std::max(1u, src.width / 2);
+  dst.height = std::max(1u, src.height / 2);
+  dst.data.resize(size_t(dst.width) * dst.height * 4);
+
+  const auto&    lut     = srgbTable();
+  const auto&    inv     = linearTable();
+  const uint32_t evenCols = std::min(dst.width, src.width / 2);
+
+  parallelRows(dst.height, dst.width, threads, [&](uint32_t rowBegin, uint32_t rowEnd) {
+    for(uint32_t y = rowBegin; y < rowEnd; y++)
+    {
+      const uint8_t* r0 = &src.data[size_t(std::min(y * 2, src.height - 1)) * src.width * 4];
+      const uint8_t* r1 = &src.data[size_t(std::min(y * 2 + 1, src.height - 1)) * src.width * 4];
+      uint8_t*       d  = &dst.data[size_t(y) * dst.width * 4];
+
+      if(srgb)
+      {
+        for(uint32_t x = 0; x < dst.width; x++)
+        {
+          uint32_t x0 = std::min(x * 2, src.width - 1) * 4, x1 = std::min(x * 2 + 1, src.width - 1) * 4;
+          for(int c = 0; c < 3; c++)
+          {
+            float v      = (lut[r0[x0 + c]] + lut[r0[x1 + c]] + lut[r1[x0 + c]] + lut[r1[x1 + c]]) * 0.25f;
+            d[x * 4 + c] = inv[std::min(int(v * kLinearLutSize), kLinearLutSize - 1)];
+          }
+          d[x * 4 + 3] = uint8_t((r0[x0 + 3] + r0[x1 + 3] + r1[x0 + 3] + r1[x1 + 3] + 2) / 4);
+        }
+      }
+      else
+      {
+        for(uint32_t i = 0; i < evenCols * 4; i++)
+        {
+          uint32_t s = (i / 4) * 8 + (i % 4);
+          d[i]       = uint8_t((r0[s] + r0[s + 4] + r1[s] + r1[s + 4] + 2) / 4);
+        }
+        // 宽度为1的源图像
+        for(uint32_t i = evenCols * 4; i < dst.width * 4; i++)
+          d[i] = uint8_t((r0[i] + r1[i] + 1) / 2);
+      }
+    }
+  });
+}
+
+// 取出一个4x4块的RGBA像素，越界的像素用边缘像素填充
+void fetchBlock(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, uint8_t block[16][4])
+{
+  for(uint32_t y = 0; y < 4; y++)
+  {
+    uint32_t sy = std::min(by * 4 + y, height - 1);
+    for(uint32_t x = 0; x < 4; x++)
+    {
+      uint32_t sx = std::min(bx * 4 + x, width - 1);
+      memcpy(block[y * 4 + x], rgba + (size_t(sy) * width + sx) * 4, 4);
+    }
+  }
+}
+
+// 包围盒端点，按协方差符号翻转对角线，使端点沿颜色主方向分布
+void boundingEndpoints(const uint8_t block[16][4], int channels, int minC[4], int maxC[4])
+{
+  int mean[4] = {0, 0, 0, 0};
+  for(int c = 0; c < channels; c++)
+  {
+    minC[c] = 255;
+    maxC[c] = 0;
+  }
+  for(int i = 0; i < 16; i++)
+  {
+    for(int c = 0; c < channels; c++)
+    {
+      minC[c] = std::min(minC[c], int(block[i][c]));
+      maxC[c] = std::max(maxC[c], int(block[i][c]));
+      mean[c] += block[i][c];
+    }
+  }
+  for(int c = 0; c < channels; c++)
+    mean[c] = (mean[c] + 8) / 16;
+
+  for(int c = 1; c < channels; c++)
+  {
+    int cov = 0;
+    for(int i = 0; i < 16; i++)
+      cov += (block[i][0] - mean[0]) * (block[i][c] - mean[c]);
+    if(cov < 0)
+      std::swap(minC[c], maxC[c]);
+  }
+}
+
+uint16_t packRGB565(int r, int g, int b)
+{
+  return static_cast<uint16_t>(((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255));
+}
+
+void unpackRGB565(uint16_t c, int rgb[3])
+{
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+// BC1颜色块（8字节），始终使用4色模式
+void encodeColorBlock(const uint8_t block[16][4], uint8_t* out)
+{
+  int minC[4], maxC[4];
+  boundingEndpoints(block, 3, minC, maxC);
+
+  // 向内收缩1/16，减小端点处的量化误差
+  for(int c = 0; c < 3; c++)
+  {
+    int inset = (maxC[c] - minC[c]) / 16;
+    minC[c] += inset;
+    maxC[c] -= inset;
+  }
+
+  uint16_t c0 = packRGB565(maxC[0], maxC[1], maxC[2]);
+  uint16_t c1 = packRGB565(minC[0], minC[1], minC[2]);
+  if(c0 < c1)
+    std::swap(c0, c1);
+
+  uint32_t indices = 0;
+  if(c0 != c1)
+  {
+    int p[4][3];
+    unpackRGB565(c0, p[0]);
+    unpackRGB565(c1, p[1]);
+    for(int c = 0; c < 3; c++)
+    {
+      p[2][c] = (2 * p[0][c] + p[1][c]) / 3;
+      p[3][c] = (p[0][c] + 2 * p[1][c]) / 3;
+    }
+    for(int i = 0; i < 16; i++)
+    {
+      int best = 0, bestErr = INT32_MAX;
+      for(int k = 0; k < 4; k++)
+      {
+        int err = 0;
+        for(int c = 0; c < 3; c++)
+          err += (block[i][c] - p[k][c]) * (block[i][c] - p[k][c]);
+        if(err < bestErr)
+        {
+          bestErr = err;
+          best    = k;
+        }
+      }
+      indices |= uint32_t(best) << (2 * i);
+    }
+  }
+
+  memcpy(out + 0, &c0, 2);
+  memcpy(out + 2, &c1, 2);
+  memcpy(out + 4, &indices, 4);
+}
+
+// BC4单通道块（8字节），8级插值模式
+void encodeChannelBlock(const uint8_t block[16][4], int channel, uint8_t* out)
+{
+  int a0 = 0, a1 = 255;
+  for(int i = 0; i < 16; i++)
+  {
+    a0 = std::max(a0, int(block[i][channel]));
+    a1 = std::min(a1, int(block[i][channel]));
+  }
+
+  uint64_t bits = uint64_t(a0) | uint64_t(a1) << 8;
+  if(a0 != a1)
+  {
+    for(int i = 0; i < 16; i++)
+    {
+      // 从a1到a0的7段中的位置，转换为调色板索引
+      int pos = ((block[i][channel] - a1) * 7 + (a0 - a1) / 2) / (a0 - a1);
+      int idx = pos == 7 ? 0 : (pos == 0 ? 1 : 8 - pos);
+      bits |= uint64_t(idx) << (16 + 3 * i);
+    }
+  }
+  memcpy(out, &bits, 8);
+}
+
+// 128位按位写入（BC7）
+struct BitWriter
+{
+  uint8_t* out;
+  uint32_t pos{0};
+
+  void write(uint32_t value, uint32_t count)
+  {
+    for(uint32_t i = 0; i < count; i++, pos++)
+    {
+      if((value >> i) & 1)
+        out[pos >> 3] |= uint8_t(1u << (pos & 7));
+    }
+  }
+};
+
+// BC7 mode 6：单子集，RGBA 7位端点 + p位，4位索引
+void encodeBC7Block(const uint8_t block[16][4], uint8_t* out)
+{
+  static const int kWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+  int minC[4], maxC[4];
+  boundingEndpoints(block, 4, minC, maxC);
+
+  // 为每个端点选择p位，使重建误差最小
+  int q[2][4], pbit[2];
+  int target[2][4];
+  for(int c = 0; c < 4; c++)
+  {
+    target[0][c] = minC[c];
+    target[1][c] = maxC[c];
+  }
+  for(int e = 0; e < 2; e++)
+  {
+    int bestErr = INT32_MAX;
+    for(int p = 0; p < 2; p++)
+    {
+      int err = 0, tq[4];
+      for(int c = 0; c < 4; c++)
+      {
+        tq[c]   = std::clamp((target[e][c] - p + 1) >> 1, 0, 127);
+        int rec = (tq[c] << 1) | p;
+        err += (rec - target[e][c]) * (rec - target[e][c]);
+      }
+      if(err < bestErr)
+      {
+        bestErr = err;
+        pbit[e] = p;
+        memcpy(q[e], tq, sizeof(tq));
+      }
+    }
+  }
+
+  int ep[2][4];
+  for(int e = 0; e < 2; e++)
+    for(int c = 0; c < 4; c++)
+      ep[e][c] = (q[e][c] << 1) | pbit[e];
+
+  int indices[16];
+  for(int i = 0; i < 16; i++)
+  {
+    int best = 0, bestErr = INT32_MAX;
+    for(int k = 0; k < 16; k++)
+    {
+      int err = 0;
+      for(int c = 0; c < 4; c++)
+      {
+        int v = ((64 - kWeights[k]) * ep[0][c] + kWeights[k] * ep[1][c] + 32) >> 6;
+        err += (block[i][c] - v) * (block[i][c] - v);
+      }
+      if(err < bestErr)
+      {
+        bestErr = err;
+        best    = k;
+      }
+    }
+    indices[i] = best;
+  }
+
+  // 锚点（第0个像素）索引的最高位必须为0，否则交换端点并翻转索引
+  if(indices[0] & 8)
+  {
+    std::swap(q[0], q[1]);
+    std::swap(pbit[0], pbit[1]);
+    for(int& idx : indices)
+      idx = 15 - idx;
+  }
+
+  memset(out, 0, 16);
+  BitWriter bw{out};
+  bw.write(1u << 6, 7);  // mode 6
+  for(int c = 0; c < 4; c++)
+  {
+    bw.write(q[0][c], 7);
+    bw.write(q[1][c], 7);
+  }
+  bw.write(pbit[0], 1);
+  bw.write(pbit[1], 1);
+  bw.write(indices[0], 3);
+  for(int i = 1; i < 16; i++)
+    bw.write(indices[i], 4);
+}
+
+// 编码一层mip
+void compressMip(TextureMip& mip, VkFormat format)
+{
+  const uint32_t bw = std::max(1u, (mip.width + 3) / 4);
+  const uint32_t bh = std::max(1u, (mip.height + 3) / 4);
+  const uint32_t bs = blockSize(format);
+
+  std::vector<uint8_t> out(size_t(bw) * bh * bs);
+  uint8_t              block[16][4];
+  for(uint32_t by = 0; by < bh; by++)
+  {
+    for(uint32_t bx = 0; bx < bw; bx++)
+    {
+      fetchBlock(mip.data.data(), mip.width, mip.height, bx, by, block);
+      uint8_t* dst = out.data() + (size_t(by) * bw + bx) * bs;
+      switch(format)
+      {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+          encodeColorBlock(block, dst);
+          break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+          encodeChannelBlock(block, 3, dst);
+          encodeColorBlock(block, dst + 8);
+          break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+          encodeChannelBlock(block, 0, dst);
+          encodeChannelBlock(block, 1, dst + 8);
+          break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+          encodeBC7Block(block, dst);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  mip.data = std::move(out);
+}
+
+uint32_t makeFourCC(char a, char b, char c, char d)
+{
+  return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+// DXGI_FORMAT -> VkFormat（只处理支持的BC格式）
+VkFormat dxgiToVkFormat(uint32_t dxgi)
+{
+  switch(dxgi)
+  {
+    case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+    case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+    case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+    case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+    case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+    case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+    case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+    default: return VK_FORMAT_UNDEFINED;
+  }
+}
+
+}  // namespace
+
+//--------------------------------------------------------------------------------------------------
+// 根据文件名猜测纹理用途
+TextureRole guessRole(const std::string& filename)
+{
+  std::string lower = filename;
+  std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+  for(const char* hint : {"normal", "_nrm", "_nor", "_n."})
+  {
+    if(lower.find(hint) != std::string::npos)
+      return TextureRole::eNormal;
+  }
+  return TextureRole::eAlbedo;
+}
+
+bool isBlockCompressed(VkFormat format)
+{
+  return blockSize(format) != 0;
+}
+
+uint32_t blockSize(VkFormat format)
+{
+  switch(format)
+  {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+      return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
+size_t mipSize(VkFormat format, uint32_t width, uint32_t height)
+{
+  uint32_t bs = blockSize(format);
+  if(bs == 0)
+    return size_t(width) * height * 4;
+  return size_t(std::max(1u, (width + 3) / 4)) * std::max(1u, (height + 3) / 4) * bs;
+}
+
+VkFormat uncompressedFormat(TextureRole role)
+{
+  return role == TextureRole::eNormal ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+VkFormat selectCompressedFormat(TextureRole role, bool hasAlpha, bool preferBC7)
+{
+  if(role == TextureRole::eNormal)
+    return VK_FORMAT_BC5_UNORM_BLOCK;
+  if(preferBC7)
+    return VK_FORMAT_BC7_SRGB_BLOCK;
+  return hasAlpha ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 读取DDS容器
+// 文件布局: "DDS " + DDS_HEADER(124字节) + [DDS_HEADER_DXT10(20字节)] + 各层mip数据
+bool loadDDS(const std::string& filename, TextureRole role, TextureData& out)
+{
+  std::ifstream file(filename, std::ios::binary);
+  if(!file)
+    return false;
+
+  uint8_t header[128];
+  if(!file.read(reinterpret_cast<char*>(header), sizeof(header)) || memcmp(header, "DDS ", 4) != 0)
+  {
+    LOGW("Not a DDS file: %s\n", filename.c_str());
+    return false;
+  }
+
+  auto readU32 = [](const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+  };
+  const uint8_t* h         = header + 4;
+  uint32_t       height    = readU32(h + 8);
+  uint32_t       width     = readU32(h + 12);
+  uint32_t       mipCount  = std::max(1u, readU32(h + 24));
+  uint32_t       fourCC    = readU32(h + 80);
+  const bool     srgbAlbedo = role == TextureRole::eAlbedo;
+
+  VkFormat format = VK_FORMAT_UNDEFINED;
+  if(fourCC == makeFourCC('D', 'X', '1', '0'))
+  {
+    uint8_t dx10[20];
+    if(!file.read(reinterpret_cast<char*>(dx10), sizeof(dx10)))
+      return false;
+    format = dxgiToVkFormat(readU32(dx10));
+  }
+  else if(fourCC == makeFourCC('D', 'X', 'T', '1'))
+    format = srgbAlbedo ? VK_FORMAT_BC1_RGBA_SRGB_BLOCK : VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+  else if(fourCC == makeFourCC('D', 'X', 'T', '5'))
+    format = srgbAlbedo ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+  else if(fourCC == makeFourCC('A', 'T', 'I', '2') || fourCC == makeFourCC('B', 'C', '5', 'U'))
+    format = VK_FORMAT_BC5_UNORM_BLOCK;
+
+  if(format == VK_FORMAT_UNDEFINED || width == 0 || height == 0)
+  {
+    LOGW("Unsupported DDS format in %s\n", filename.c_str());
+    return false;
+  }
+
+  out.format = format;
+  out.mips.clear();
+  for(uint32_t level = 0; level < mipCount; level++)
+  {
+    TextureMip mip;
+    mip.width  = std::max(1u, width >> level);
+    mip.height = std::max(1u, height >> level);
+    mip.data.resize(mipSize(format, mip.width, mip.height));
+    if(!file.read(reinterpret_cast<char*>(mip.data.data()), mip.data.size()))
+    {
+      // 截断的文件：保留已读取的mip
+      if(level == 0)
+        return false;
+      break;
+    }
+    out.mips.emplace_back(std::move(mip));
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 生成RGBA8 mip链，mips[0]为原图
+void buildMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, std::vector<TextureMip>& mips, uint32_t threads)
+{
+  mips.clear();
+  TextureMip base;
+  base.width  = width;
+  base.height = height;
+  base.data.assign(rgba, rgba + size_t(width) * height * 4);
+  mips.emplace_back(std::move(base));
+
+  while(mips.back().width > 1 || mips.back().height > 1)
+  {
+    TextureMip dst;
+    downsample2x(mips.back(), dst, srgb, threads);
+    mips.emplace_back(std::move(dst));
+  }
+}
+
+//--------------------------------------------------------------------------------------------------
+// 解码后立即缩小到分辨率上限以内（每次2x盒式滤波）
+void downsampleToFit(std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height, uint32_t maxResolution, bool srgb, uint32_t threads)
+{
+  if(maxResolution == 0)
+    return;
+
+  TextureMip level{width, height, std::move(rgba)};
+  while(std::max(level.width, level.height) > maxResolution)
+  {
+    TextureMip dst;
+    downsample2x(level, dst, srgb, threads);
+    level = std::move(dst);
+  }
+  width  = level.width;
+  height = level.height;
+  rgba   = std::move(level.data);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 预生成mip的纹理（如DDS）：直接丢弃超过分辨率上限的顶层mip
+void dropMipsAbove(TextureData& texture, uint32_t maxResolution)
+{
+  if(maxResolution == 0)
+    return;
+
+  size_t first = 0;
+  while(first + 1 < texture.mips.size() && std::max(texture.mips[first].width, texture.mips[first].height) > maxResolution)
+    first++;
+  texture.mips.erase(texture.mips.begin(), texture.mips.begin() + first);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 读取纹理文件，输出完整mip链
+bool loadFile(const std::string& filename, TextureRole role, const TextureOptions& options, TextureData& out, AlphaRange* alpha, uint32_t alphaResolution)
+{
+  out = {};
+  if(filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".dds") == 0)
+  {
+    if(!loadDDS(filename, role, out))
+      return false;
+    if(alpha)
+      formatAlphaRange(out.format, *alpha);
+    dropMipsAbove(out, options.maxResolution);
+    return true;
+  }
+
+  int      width, height, channels;
+  stbi_uc* pixels = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if(!pixels)
+  {
+    LOGW("Failed to load texture %s\n", filename.c_str());
+    return false;
+  }
+
+  if(alpha)
+    buildAlphaRange(pixels, width, height, alphaResolution, *alpha);
+
+  bool                 srgb = role == TextureRole::eAlbedo;
+  uint32_t             w = width, h = height;
+  std::vector<uint8_t> rgba(pixels, pixels + size_t(w) * h * 4);
+  stbi_image_free(pixels);
+  downsampleToFit(rgba, w, h, options.maxResolution, srgb, options.threads);
+
+  buildMipChain(rgba.data(), w, h, srgb, out.mips, options.threads);
+  out.format = uncompressedFormat(role);
+  if(options.compress)
+    compress(out, selectCompressedFormat(role, hasAlpha(rgba.data(), w, h), options.preferBC7));
+
+  return true;
+}
+
+bool hasAlpha(const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+  for(size_t i = 0; i < size_t(width) * height; i++)
+  {
+    if(rgba[i * 4 + 3] != 255)
+      return true;
+  }
+  return false;
+}
+
+void compress(TextureData& texture, VkFormat format)
+{
+  for(auto& mip : texture.mips)
+    compressMip(mip, format);
+  texture.format = format;
+}
+
+//--------------------------------------------------------------------------------------------------
+// alpha范围图：每个格子覆盖 cell x cell 个原始像素（边缘的格子可能更少）
+void buildAlphaRange(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t maxResolution, AlphaRange& out)
+{
+  uint32_t cell = 1;
+  while(maxResolution > 0 && std::max(width, height) > cell * maxResolution)
+    cell *= 2;
+
+  out.width       = (width + cell - 1) / cell;
+  out.height      = (height + cell - 1) / cell;
+  out.texelWidth  = width;
+  out.texelHeight = height;
+  out.cellSize    = cell;
+  out.minAlpha.assign(size_t(out.width) * out.height, 255);
+  out.maxAlpha.assign(size_t(out.width) * out.height, 0);
+  for(uint32_t y = 0; y < height; y++)
+  {
+    for(uint32_t x = 0; x < width; x++)
+    {
+      uint8_t a = rgba[(size_t(y) * width + x) * 4 + 3];
+      size_t  c = size_t(y / cell) * out.width + x / cell;
+      out.minAlpha[c] = std::min(out.minAlpha[c], a);
+      out.maxAlpha[c] = std::max(out.maxAlpha[c], a);
+    }
+  }
+}
+
+void formatAlphaRange(VkFormat format, AlphaRange& out)
+{
+  bool alpha = format != VK_FORMAT_BC1_RGB_UNORM_BLOCK && format != VK_FORMAT_BC1_RGB_SRGB_BLOCK
+               && format != VK_FORMAT_BC5_UNORM_BLOCK;
+  out             = {};
+  out.width       = 1;
+  out.height      = 1;
+  out.texelWidth  = 1;
+  out.texelHeight = 1;
+  out.minAlpha    = {alpha ? uint8_t(0) : uint8_t(255)};
+  out.maxAlpha    = {255};
+}
+
+AlphaCoverage alphaCoverage(const AlphaRange& range, const float uv[6], uint8_t cutoff)
+{
+  if(range.empty())
+    return AlphaCoverage::eMixed;
+
+  float minU = std::min({uv[0], uv[2], uv[4]}), maxU = std::max({uv[0], uv[2], uv[4]});
+  float minV = std::min({uv[1], uv[3], uv[5]}), maxV = std::max({uv[1], uv[3], uv[5]});
+  if(!std::isfinite(minU) || !std::isfinite(maxU) || !std::isfinite(minV) || !std::isfinite(maxV))
+    return AlphaCoverage::eMixed;
+
+  // 纹理坐标包围盒内双线性插值会读取的像素（重复寻址），换算为格子；跨度超过一个周期时覆盖整张图
+  auto cellsOf = [](float lo, float hi, uint32_t texels, uint32_t cellSize, std::vector<uint32_t>& cells) {
+    double   first = std::floor(double(lo) * texels - 0.5);
+    double   span  = std::floor(double(hi) * texels - 0.5) + 2.0 - first;
+    uint32_t count = span >= texels ? texels : static_cast<uint32_t>(span);
+    double   start = std::fmod(first, double(texels));
+    auto     t0    = static_cast<uint32_t>(start < 0.0 ? start + texels : start) % texels;
+    cells.clear();
+    for(uint32_t i = 0; i < count; i++)
+    {
+      uint32_t c = (t0 + i) % texels / cellSize;
+      if(cells.empty() || cells.back() != c)
+        cells.push_back(c);
+    }
+  };
+  std::vector<uint32_t> xs, ys;
+  cellsOf(minU, maxU, range.texelWidth, range.cellSize, xs);
+  cellsOf(minV, maxV, range.texelHeight, range.cellSize, ys);
+
+  bool allAbove = true;  // 所有格子的最小alpha >= cutoff
+  bool allBelow = true;  // 所有格子的最大alpha < cutoff
+  for(size_t j = 0; j < ys.size() && (allAbove || allBelow); j++)
+  {
+    for(size_t i = 0; i < xs.size() && (allAbove || allBelow); i++)
+    {
+      size_t c = size_t(ys[j]) * range.width + xs[i];
+      allAbove &= range.minAlpha[c] >= cutoff;
+      allBelow &= range.maxAlpha[c] < cutoff;
+    }
+  }
+  if(allAbove)
+    return AlphaCoverage::eOpaque;
+  return allBelow ? AlphaCoverage::eTransparent : AlphaCoverage::eMixed;
+}
+
+}  // namespace tex
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "vulkan/vulkan_core.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// 纹理加载与块压缩（BC1/BC3/BC5/BC7）
+// - 支持直接读取预压缩的 DDS 容器（含 mip 链）
+// - 对未压缩的源图片，可在 CPU 上生成 mip 链并编码为 BC 格式
+// - 根据纹理用途（albedo / normal）选择格式
+//
+
+// 纹理在材质中的用途，决定颜色空间与压缩格式
+enum class TextureRole
+{
+  eAlbedo,  // 颜色贴图：sRGB，BC1/BC3/BC7
+  eNormal   // 法线贴图：线性，BC5（只保存xy）
+};
+
+// 一层mip的数据（RGBA8 或 BC 块数据）
+struct TextureMip
+{
+  uint32_t             width{0};
+  uint32_t             height{0};
+  std::vector<uint8_t> data;
+};
+
+// CPU端纹理，mips[0]为最高分辨率
+struct TextureData
+{
+  VkFormat                format{VK_FORMAT_UNDEFINED};
+  std::vector<TextureMip> mips;
+
+  bool     empty() const { return mips.empty(); }
+  uint32_t width() const { return mips.empty() ? 0 : mips[0].width; }
+  uint32_t height() const { return mips.empty() ? 0 : mips[0].height; }
+};
+
+// 纹理加载选项
+struct TextureOptions
+{
+  bool     compress{false};      // 未压缩的源图片是否在CPU上编码为BC格式
+  bool     preferBC7{true};      // albedo 使用 BC7（质量更好），否则使用 BC1/BC3
+  uint32_t maxResolution{0};     // 分辨率上限（最长边，像素），解码时即缩小，0 表示不限制
+  bool     cpuMips{false};       // 未压缩纹理在CPU上生成mip（否则在GPU上用blit生成）
+  uint32_t threads{0};           // CPU缩放/生成mip的线程数，0 表示使用全部硬件线程
+  float    lodBias{0.0f};        // 采样器的 mipLodBias，预览时可调大以使用更小的mip
+};
+
+namespace tex {
+
+// 纹理alpha的粗分辨率范围图，用于在host上预先判断三角形是否需要alpha测试（见 HelloVulkan::buildSubsets）
+// 每个格子保存它覆盖的原始像素alpha的最小值和最大值；原始分辨率上的双线性插值结果落在相邻格子的范围内
+// 更粗的mip（分辨率上限、流式加载只有尾部常驻时）是更大区域的平均，可能超出这个范围，此时按原始分辨率的分类为准
+struct AlphaRange
+{
+  uint32_t             width{0};   // 格子数
+  uint32_t             height{0};
+  uint32_t             texelWidth{0};  // 原始图片的像素数
+  uint32_t             texelHeight{0};
+  uint32_t             cellSize{1};    // 每个格子的边长（像素）
+  std::vector<uint8_t> minAlpha;
+  std::vector<uint8_t> maxAlpha;
+
+  bool empty() const { return width == 0 || height == 0; }
+  // 所有像素都不透明，不需要alpha测试
+  bool opaque() const { return !empty() && *std::min_element(minAlpha.begin(), minAlpha.end()) == 255; }
+};
+
+// 三角形在alpha测试下的覆盖情况
+enum class AlphaCoverage
+{
+  eOpaque,       // 所有采样都不低于阈值，可以设opaque跳过any-hit
+  eMixed,        // 需要any-hit逐次测试
+  eTransparent,  // 所有采样都低于阈值，永远不会被命中
+};
+
+// 根据文件名猜测纹理用途（包含 normal/nrm 等字样视为法线贴图）
+TextureRole guessRole(const std::string& filename);
+
+// 是否为块压缩格式
+bool isBlockCompressed(VkFormat format);
+
+// 每个4x4块的字节数，非压缩格式返回0
+uint32_t blockSize(VkFormat format);
+
+// 一层mip的字节数（压缩格式按块计算，非压缩按RGBA8计算）
+size_t mipSize(VkFormat format, uint32_t width, uint32_t height);
+
+// 未压缩纹理的格式：albedo 为 sRGB，normal 为 UNORM
+VkFormat uncompressedFormat(TextureRole role);
+
+// 根据用途和是否有透明通道选择BC格式
+VkFormat selectCompressedFormat(TextureRole role, bool hasAlpha, bool preferBC7);
+
+// 读取 DDS 容器（BC1/BC3/BC5/BC7，FourCC 或 DX10 头），失败返回false
+// role 用于没有颜色空间信息的旧式 FourCC 文件
+bool loadDDS(const std::string& filename, TextureRole role, TextureData& out);
+
+// 用 RGBA8 像素生成完整的 mip 链（2x2盒式滤波），srgb 为 true 时在线性空间中滤波
+// 大图按行分给 threads 个线程（0 表示全部硬件线程）
+void buildMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, bool srgb, std::vector<TextureMip>& mips, uint32_t threads = 0);
+
+// 反复2x缩小 RGBA8 图像，直到最长边不超过 maxResolution（0 表示不限制）
+void downsampleToFit(std::vector<uint8_t>& rgba, uint32_t& width, uint32_t& height, uint32_t maxResolution, bool srgb, uint32_t threads = 0);
+
+// 丢弃最长边超过 maxResolution 的顶层mip（用于已含mip链的DDS）
+void dropMipsAbove(TextureData& texture, uint32_t maxResolution);
+
+// 读取纹理文件（DDS 或 stb 支持的图片）并生成完整 mip 链，应用 options.maxResolution 上限
+// options.compress 为 true 时，未压缩的图片在CPU上编码为BC格式（调用者需确认设备支持）
+// alpha 不为空时顺便用解码出的原始像素生成alpha范围图（最长边不超过 alphaResolution，DDS见 formatAlphaRange）
+bool loadFile(const std::string&    filename,
+              TextureRole           role,
+              const TextureOptions& options,
+              TextureData&          out,
+              AlphaRange*           alpha           = nullptr,
+              uint32_t              alphaResolution = 0);
+
+// 判断 RGBA8 像素是否含有非不透明的alpha
+bool hasAlpha(const uint8_t* rgba, uint32_t width, uint32_t height);
+
+// 将 RGBA8 的 mip 链编码为指定BC格式，原地替换数据
+void compress(TextureData& texture, VkFormat format);
+
+// RGBA8 像素的alpha范围图，最长边不超过 maxResolution（0 表示不缩小）
+void buildAlphaRange(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t maxResolution, AlphaRange& out);
+
+// 块压缩纹理的alpha范围图：不解码块，只按格式判断，可能含alpha的格式得到一个 [0, 255] 的格子
+void formatAlphaRange(VkFormat format, AlphaRange& out);
+
+// 纹理坐标为 uv[0..5]（三个顶点的u、v）的三角形的覆盖情况，按重复寻址和三角形的包围盒保守判断
+// cutoff：alpha低于它的采样被丢弃（与 ALPHA_CUTOFF 一致，0..255）
+AlphaCoverage alphaCoverage(const AlphaRange& range, const float uv[6], uint8_t cutoff);
+
+}  // namespace tex
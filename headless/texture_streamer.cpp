@@ -0,0 +1,353 @@
+#include "texture_streamer.hpp"
+
+#include "nvh/nvprint.hpp"
+#include "nvvk/images_vk.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+static constexpr uint32_t kNotRequested = ~0u;
+
+//--------------------------------------------------------------------------------------------------
+//
+void TextureStreamer::init(VkDevice device, uint32_t queueFamily, nvvk::ResourceAllocator* alloc, StagingRing* ring)
+{
+  m_device = device;
+  m_alloc  = alloc;
+  m_ring   = ring;
+  m_cmdPool.init(device, queueFamily);
+}
+
+void TextureStreamer::deinit()
+{
+  // 等待仍在后台运行的加载
+  for(auto& e : m_entries)
+  {
+    if(e.pending.valid())
+      e.pending.wait();
+  }
+  m_entries.clear();
+  m_initialInfos.clear();
+
+  if(m_infos)
+  {
+    m_alloc->unmap(m_infoBuffer);
+    m_infos = nullptr;
+  }
+  m_alloc->destroy(m_infoBuffer);
+  m_cmdPool.deinit();
+  m_usedBytes  = 0;
+  m_cacheBytes = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 创建纹理并逐层上传
+nvvk::Texture TextureStreamer::createTexture(nvvk::ResourceAllocator&   alloc,
+                                             const VkCommandBuffer&     cmdBuf,
+                                             VkFormat                   format,
+                                             const TextureMip*          mips,
+                                             uint32_t                   mipCount,
+                                             const VkSamplerCreateInfo& samplerInfo,
+                                             StagingRing*               ring)
+{
+  auto imgSize         = VkExtent2D{mips[0].width, mips[0].height};
+  auto imageCreateInfo = nvvk::makeImage2DCreateInfo(imgSize, format, VK_IMAGE_USAGE_SAMPLED_BIT);
+  imageCreateInfo.mipLevels = mipCount;
+
+  nvvk::Image             image = alloc.createImage(imageCreateInfo);
+  VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, mipCount, 0, 1};
+  nvvk::cmdBarrierImageLayout(ring ? ring->cmd() : cmdBuf, image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, range);
+
+  for(uint32_t level = 0; level < mipCount; level++)
+  {
+    const TextureMip&        mip = mips[level];
+    VkImageSubresourceLayers subresource{VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    if(ring)
+      ring->uploadImage(image.image, subresource, {mip.width, mip.height, 1}, format, mip.data.data(), mip.data.size());
+    else
+      alloc.getStaging()->cmdToImage(cmdBuf, image.image, {0, 0, 0}, {mip.width, mip.height, 1}, subresource,
+                                     mip.data.size(), mip.data.data());
+  }
+  // 大的mip可能跨多个段提交，转换记录在最后一段中
+  nvvk::cmdBarrierImageLayout(ring ? ring->cmd() : cmdBuf, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, range);
+
+  VkImageViewCreateInfo ivInfo = nvvk::makeImageViewCreateInfo(image.image, imageCreateInfo);
+  return alloc.createTexture(image, ivInfo, samplerInfo);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 注册流式纹理，只上传mip尾部
+nvvk::Texture TextureStreamer::addTexture(const VkCommandBuffer&     cmdBuf,
+                                          const std::string&         filename,
+                                          TextureRole                role,
+                                          const TextureOptions&      options,
+                                          const VkSamplerCreateInfo& samplerInfo,
+                                          tex::AlphaRange*           alpha,
+                                          uint32_t                   alphaResolution)
+{
+  m_textureOptions = options;
+  m_samplerInfo    = samplerInfo;
+
+  TextureData data;
+  if(!tex::loadFile(filename, role, options, data, alpha, alphaResolution))
+  {
+    // 兜底：紫色，不参与流式加载
+    TextureMip mip{1, 1, {255u, 0u, 255u, 255u}};
+    addResident(1, 1);
+    return createTexture(*m_alloc, cmdBuf, tex::uncompressedFormat(role), &mip, 1, samplerInfo, m_ring);
+  }
+
+  // 尾部：第一层边长不超过 tailSize 的mip及之后所有层
+  uint32_t tailMip = 0;
+  while(tailMip + 1 < data.mips.size() && std::max(data.mips[tailMip].width, data.mips[tailMip].height) > m_options.tailSize)
+    tailMip++;
+
+  Entry entry;
+  entry.streamed  = tailMip > 0;
+  entry.filename  = filename;
+  entry.role      = role;
+  entry.format    = data.format;
+  entry.width     = data.width();
+  entry.height    = data.height();
+  entry.tailMip   = tailMip;
+  entry.wantedMip = tailMip;
+  entry.tail.assign(data.mips.begin() + tailMip, data.mips.end());
+
+  pushInfo({data.width(), data.height(), tailMip, kNotRequested});
+  nvvk::Texture texture = createTexture(*m_alloc, cmdBuf, entry.format, entry.tail.data(),
+                                        static_cast<uint32_t>(entry.tail.size()), samplerInfo, m_ring);
+  m_entries.emplace_back(std::move(entry));
+  // 已经解码的完整链直接放入缓存，第一次请求更精细的mip时不需要再读取文件
+  if(m_entries.back().streamed)
+    storeCache(static_cast<uint32_t>(m_entries.size() - 1), std::make_shared<const TextureData>(std::move(data)));
+  return texture;
+}
+
+void TextureStreamer::addResident(uint32_t width, uint32_t height)
+{
+  m_entries.emplace_back();
+  pushInfo({width, height, 0, kNotRequested});
+}
+
+void TextureStreamer::pushInfo(const TextureInfo& info)
+{
+  uint32_t index = static_cast<uint32_t>(m_initialInfos.size());
+  m_initialInfos.push_back(info);
+  if(m_infos && index < m_infoCapacity)
+    m_infos[index] = info;
+  else if(m_infos)
+    LOGE("Texture streaming: more than %u textures, TextureInfo buffer is full\n", m_infoCapacity);
+}
+
+//--------------------------------------------------------------------------------------------------
+// TextureInfo buffer：host写入常驻状态，closest hit 写入 feedback
+void TextureStreamer::createInfoBuffer(uint32_t capacity)
+{
+  m_infoCapacity    = std::max<uint32_t>({capacity, static_cast<uint32_t>(m_initialInfos.size()), 1u});
+  VkDeviceSize size = VkDeviceSize(m_infoCapacity) * sizeof(TextureInfo);
+  m_infoBuffer      = m_alloc->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  m_infos           = static_cast<TextureInfo*>(m_alloc->map(m_infoBuffer));
+  std::copy(m_initialInfos.begin(), m_initialInfos.end(), m_infos);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 从 mip 到尾部之前的字节数
+VkDeviceSize TextureStreamer::bytesAbove(const Entry& entry, uint32_t mip) const
+{
+  VkDeviceSize bytes = 0;
+  for(uint32_t level = mip; level < entry.tailMip; level++)
+    bytes += tex::mipSize(entry.format, std::max(entry.width >> level, 1u), std::max(entry.height >> level, 1u));
+  return bytes;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 缓存第 index 个纹理的完整mip链：按最近使用时间丢弃其他纹理的缓存，直到总量不超过 cacheBudget，放不下时不缓存
+// 后台加载仍持有的缓存由 shared_ptr 保持，加载完成后释放
+void TextureStreamer::storeCache(uint32_t index, TextureDataPtr data)
+{
+  VkDeviceSize bytes = 0;
+  for(const TextureMip& mip : data->mips)
+    bytes += mip.data.size();
+  if(bytes > m_options.cacheBudget)
+    return;
+
+  while(m_cacheBytes + bytes > m_options.cacheBudget)
+  {
+    uint32_t victim = kNotRequested;
+    for(uint32_t i = 0; i < m_entries.size(); i++)
+    {
+      const Entry& e = m_entries[i];
+      if(i == index || !e.cache)
+        continue;
+      if(victim == kNotRequested || e.lastUsed < m_entries[victim].lastUsed)
+        victim = i;
+    }
+    if(victim == kNotRequested)
+      return;
+    m_cacheBytes -= m_entries[victim].cacheBytes;
+    m_entries[victim].cache.reset();
+    m_entries[victim].cacheBytes = 0;
+  }
+
+  Entry& e = m_entries[index];
+  m_cacheBytes = m_cacheBytes - e.cacheBytes + bytes;
+  e.cache      = std::move(data);
+  e.cacheBytes = bytes;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 把纹理退回到mip尾部
+void TextureStreamer::evict(uint32_t index, std::vector<nvvk::Texture>& textures, const VkCommandBuffer& cmdBuf)
+{
+  Entry& e = m_entries[index];
+  m_alloc->destroy(textures[index]);
+  textures[index] = createTexture(*m_alloc, cmdBuf, e.format, e.tail.data(), static_cast<uint32_t>(e.tail.size()), m_samplerInfo, m_ring);
+  m_infos[index].residentMip = e.tailMip;
+  m_usedBytes -= e.bytes;
+  e.bytes = 0;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 按LRU淘汰，直到能放下 needed 字节；本帧用到的纹理不淘汰
+bool TextureStreamer::makeRoom(VkDeviceSize                needed,
+                               uint32_t                    keep,
+                               std::vector<nvvk::Texture>& textures,
+                               const VkCommandBuffer&      cmdBuf,
+                               std::vector<uint32_t>&      changed)
+{
+  while(m_usedBytes + needed > m_options.budget)
+  {
+    uint32_t victim = kNotRequested;
+    for(uint32_t i = 0; i < m_entries.size(); i++)
+    {
+      const Entry& e = m_entries[i];
+      if(i == keep || e.bytes == 0 || e.lastUsed == m_frame)
+        continue;
+      if(victim == kNotRequested || e.lastUsed < m_entries[victim].lastUsed)
+        victim = i;
+    }
+    if(victim == kNotRequested)
+      return false;
+
+    evict(victim, textures, cmdBuf);
+    changed.push_back(victim);
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 每帧调用一次
+std::vector<uint32_t> TextureStreamer::update(std::vector<nvvk::Texture>& textures)
+{
+  std::vector<uint32_t> changed;
+  if(!m_infos)
+    return changed;
+  m_frame++;
+
+  // 超出 TextureInfo 容量的纹理没有feedback，保持常驻的mip尾部
+  const uint32_t count = std::min(static_cast<uint32_t>(m_entries.size()), m_infoCapacity);
+
+  // 1. 读取feedback并重置
+  for(uint32_t i = 0; i < count; i++)
+  {
+    uint32_t requested      = m_infos[i].requestedMip;
+    m_infos[i].requestedMip = kNotRequested;
+    if(requested == kNotRequested || !m_entries[i].streamed)
+      continue;
+    m_entries[i].lastUsed  = m_frame;
+    m_entries[i].wantedMip = std::min(requested, m_entries[i].tailMip);
+  }
+
+  // 2. 替换后台已准备好的纹理
+  VkCommandBuffer cmdBuf  = VK_NULL_HANDLE;
+  uint32_t        uploads = 0;
+  for(uint32_t i = 0; i < count && uploads < m_options.maxUploadsPerFrame; i++)
+  {
+    Entry& e = m_entries[i];
+    if(!e.pending.valid() || e.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      continue;
+
+    TextureDataPtr data = e.pending.get();
+    if(!data || data->format != e.format || e.pendingMip >= data->mips.size())
+    {
+      LOGW("Texture streaming: failed to load %s, keeping the mip tail\n", e.filename.c_str());
+      e.streamed = false;
+      continue;
+    }
+    if(data != e.cache)
+      storeCache(i, data);
+
+    if(!cmdBuf)
+      cmdBuf = m_cmdPool.createCommandBuffer();
+
+    VkDeviceSize bytes = bytesAbove(e, e.pendingMip);
+    if(bytes > e.bytes && !makeRoom(bytes - e.bytes, i, textures, cmdBuf, changed))
+      continue;  // 预算不足，丢弃，之后再请求
+
+    m_alloc->destroy(textures[i]);
+    textures[i] = createTexture(*m_alloc, cmdBuf, e.format, data->mips.data() + e.pendingMip,
+                                static_cast<uint32_t>(data->mips.size() - e.pendingMip), m_samplerInfo, m_ring);
+    m_infos[i].residentMip = e.pendingMip;
+    m_usedBytes            = m_usedBytes - e.bytes + bytes;
+    e.bytes                = bytes;
+    changed.push_back(i);
+    uploads++;
+  }
+
+  if(cmdBuf)
+  {
+    m_cmdPool.submitAndWait(cmdBuf);
+    m_alloc->finalizeAndReleaseStaging();
+    if(m_ring)
+      m_ring->flush();
+  }
+
+  // 3. 为需要更精细mip的纹理启动后台加载
+  // 可用空间 = 预算剩余 + 本帧未使用、可被淘汰的纹理，避免加载完成后又因预算不足被丢弃
+  uint32_t     pendingCount = 0;
+  VkDeviceSize available    = m_options.budget - std::min(m_usedBytes, m_options.budget);
+  for(const Entry& e : m_entries)
+  {
+    if(e.pending.valid())
+      pendingCount++;
+    if(e.lastUsed != m_frame)
+      available += e.bytes;
+  }
+
+  for(uint32_t i = 0; i < count && pendingCount < m_options.maxPendingLoads; i++)
+  {
+    Entry&   e   = m_entries[i];
+    uint32_t mip = e.wantedMip;
+    if(!e.streamed || e.pending.valid() || e.lastUsed != m_frame || mip >= m_infos[i].residentMip)
+      continue;
+
+    VkDeviceSize needed = bytesAbove(e, mip) - e.bytes;
+    if(needed > available)
+      continue;
+    available -= needed;
+
+    e.pendingMip = mip;
+    if(e.cache)
+    {
+      // 缓存命中：不读取文件，下一帧直接上传
+      std::promise<TextureDataPtr> ready;
+      ready.set_value(e.cache);
+      e.pending = ready.get_future();
+    }
+    else
+    {
+      e.pending = std::async(std::launch::async, [filename = e.filename, role = e.role, options = m_textureOptions]() {
+        auto data = std::make_shared<TextureData>();
+        if(!tex::loadFile(filename, role, options, *data))
+          data.reset();
+        return TextureDataPtr(std::move(data));
+      });
+    }
+    pendingCount++;
+  }
+
+  return changed;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "nvvk/commands_vk.hpp"
+#include "nvvk/resourceallocator_vk.hpp"
+
+#include "shaders/host_device.h"
+#include "staging_ring.hpp"
+#include "texture_loader.hpp"
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// 纹理流式加载
+// - 加载模型时只上传低分辨率的 mip 尾部（tail），尾部始终常驻显存
+// - closest hit 把每个纹理需要的最精细 mip 写入 TextureInfo::requestedMip（feedback）
+// - 每帧结束后读取 feedback，在后台线程准备更精细的 mip，完成后替换纹理
+// - 读取文件得到的完整 mip 链缓存在CPU端（不超过 cacheBudget），被淘汰后再次请求时直接取用，不再读取和解码文件
+// - 超出显存预算时，按最近最少使用（LRU）把纹理退回到 mip 尾部
+//
+// 每个 m_textures 中的纹理都有一个对应的 TextureInfo，未流式加载的纹理 residentMip 恒为0
+//
+struct StreamingOptions
+{
+  bool         enable{false};            // 是否对新加载的纹理启用流式加载
+  uint32_t     tailSize{64};             // mip 尾部的最大边长（像素）
+  VkDeviceSize budget{256ull << 20};     // 尾部以外的 mip 可用的显存预算（字节）
+  uint32_t     maxUploadsPerFrame{2};    // 每帧最多替换的纹理数
+  uint32_t     maxPendingLoads{4};       // 同时在后台准备的纹理数
+  VkDeviceSize cacheBudget{512ull << 20};  // CPU端缓存的完整 mip 链总量（字节），超出时按LRU丢弃，0 表示不缓存
+};
+
+class TextureStreamer
+{
+public:
+  // ring 不为空时，mip数据经由staging ring分块上传
+  void init(VkDevice device, uint32_t queueFamily, nvvk::ResourceAllocator* alloc, StagingRing* ring = nullptr);
+  void deinit();
+
+  void                    setOptions(const StreamingOptions& options) { m_options = options; }
+  const StreamingOptions& getOptions() const { return m_options; }
+  bool                    isEnabled() const { return m_options.enable; }
+
+  // 注册一个流式纹理：读取文件，只上传 mip 尾部，返回的纹理放入场景纹理数组的末尾
+  // alpha 不为空时同时生成alpha范围图（见 tex::loadFile）
+  nvvk::Texture addTexture(const VkCommandBuffer&     cmdBuf,
+                           const std::string&         filename,
+                           TextureRole                role,
+                           const TextureOptions&      options,
+                           const VkSamplerCreateInfo& samplerInfo,
+                           tex::AlphaRange*           alpha           = nullptr,
+                           uint32_t                   alphaResolution = 0);
+  // 注册一个完整常驻的纹理（不参与流式加载）
+  void addResident(uint32_t width, uint32_t height);
+
+  // 创建容纳 capacity 个纹理的 TextureInfo buffer（host可见，持久映射）
+  // 之后注册的纹理直接写入映射的buffer，运行时追加纹理不需要重建
+  void         createInfoBuffer(uint32_t capacity);
+  nvvk::Buffer getInfoBuffer() const { return m_infoBuffer; }
+
+  // 帧与帧之间调用（上一帧的GPU工作必须已完成）
+  // 读取feedback、替换后台准备好的纹理、按预算淘汰，返回需要重写描述符的纹理索引
+  std::vector<uint32_t> update(std::vector<nvvk::Texture>& textures);
+
+  VkDeviceSize getUsedBytes() const { return m_usedBytes; }
+
+  // 用 mips[0..mipCount) 创建纹理并上传所有层，image 最终为 SHADER_READ_ONLY_OPTIMAL
+  // ring 不为空时命令录制在 ring 中（cmdBuf 不使用），调用者需在使用纹理前 flush
+  static nvvk::Texture createTexture(nvvk::ResourceAllocator&   alloc,
+                                     const VkCommandBuffer&     cmdBuf,
+                                     VkFormat                   format,
+                                     const TextureMip*          mips,
+                                     uint32_t                   mipCount,
+                                     const VkSamplerCreateInfo& samplerInfo,
+                                     StagingRing*               ring = nullptr);
+
+private:
+  using TextureDataPtr = std::shared_ptr<const TextureData>;
+
+  struct Entry
+  {
+    bool                    streamed{false};
+    std::string             filename;
+    TextureRole             role{TextureRole::eAlbedo};
+    VkFormat                format{VK_FORMAT_UNDEFINED};
+    uint32_t                width{0};       // mip 0 的分辨率
+    uint32_t                height{0};
+    uint32_t                tailMip{0};     // 尾部第一层
+    std::vector<TextureMip> tail;           // 尾部数据，淘汰时用于重建
+    uint32_t                wantedMip{0};   // feedback 请求的最精细mip
+    uint64_t                lastUsed{0};    // 最近一次被采样的帧
+    VkDeviceSize            bytes{0};       // 尾部以外已常驻的字节数
+    uint32_t                pendingMip{0};  // 后台加载的目标mip
+    std::future<TextureDataPtr> pending;      // 后台加载的完整 mip 链，失败时为空
+    TextureDataPtr          cache;          // 缓存的完整 mip 链，为空时从文件读取
+    VkDeviceSize            cacheBytes{0};
+  };
+
+  VkDeviceSize bytesAbove(const Entry& entry, uint32_t mip) const;
+  void         storeCache(uint32_t index, TextureDataPtr data);
+  bool         makeRoom(VkDeviceSize needed, uint32_t keep, std::vector<nvvk::Texture>& textures, const VkCommandBuffer& cmdBuf, std::vector<uint32_t>& changed);
+  void         evict(uint32_t index, std::vector<nvvk::Texture>& textures, const VkCommandBuffer& cmdBuf);
+  void         pushInfo(const TextureInfo& info);
+
+  VkDevice                 m_device{VK_NULL_HANDLE};
+  nvvk::ResourceAllocator* m_alloc{nullptr};
+  StagingRing*             m_ring{nullptr};
+  nvvk::CommandPool        m_cmdPool;
+
+  StreamingOptions         m_options;
+  TextureOptions           m_textureOptions;
+  VkSamplerCreateInfo      m_samplerInfo{VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+  std::vector<Entry>       m_entries;
+  std::vector<TextureInfo> m_initialInfos;  // buffer创建前的状态
+
+  nvvk::Buffer m_infoBuffer;
+  TextureInfo* m_infos{nullptr};
+  uint32_t     m_infoCapacity{0};
+  VkDeviceSize m_usedBytes{0};
+  VkDeviceSize m_cacheBytes{0};
+  uint64_t     m_frame{0};
+};
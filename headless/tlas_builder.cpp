@@ -0,0 +1,291 @@
+#include "tlas_builder.hpp"
+#include "embedded_spirv.hpp"
+
+#include "nvh/nvprint.hpp"
+#include "nvvk/buffers_vk.hpp"
+#include "nvvk/shaders_vk.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// 与 tlas_instance.glsl 中的 InstanceDelta 一致
+struct InstanceDelta
+{
+  uint32_t                           index;
+  uint32_t                           pad[3];
+  VkAccelerationStructureInstanceKHR instance;
+};
+static_assert(sizeof(VkAccelerationStructureInstanceKHR) == 64, "instance layout must match AccelInstance");
+static_assert(sizeof(InstanceDelta) == 80, "delta layout must match tlas_instance.glsl");
+
+static constexpr uint32_t kWorkgroupSize = 64;
+
+static VkDeviceSize alignUp(VkDeviceSize v, VkDeviceSize a)
+{
+  return (v + a - 1) / a * a;
+}
+
+//--------------------------------------------------------------------------------------------------
+//
+void TlasBuilder::init(VkDevice                 device,
+                       VkPhysicalDevice         physicalDevice,
+                       uint32_t                 queueFamily,
+                       nvvk::ResourceAllocator* alloc,
+                       VkPipelineCache          pipelineCache)
+{
+  m_device = device;
+  m_alloc  = alloc;
+  m_cmdPool.init(device, queueFamily);
+
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  properties.pNext = &asProperties;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+  m_scratchAlignment = std::max<VkDeviceSize>(asProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+  m_timestampPeriod  = properties.properties.limits.timestampPeriod;
+
+  VkPushConstantRange        pushConstant{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantTlas)};
+  VkPipelineLayoutCreateInfo layoutInfo{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges    = &pushConstant;
+  vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_pipelineLayout);
+
+  m_scatterPipeline = createPipeline("tlas_scatter.comp.spv", pipelineCache);
+  m_animatePipeline = createPipeline("tlas_animate.comp.spv", pipelineCache);
+
+  VkQueryPoolCreateInfo queryInfo{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  queryInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  queryInfo.queryCount = 2;
+  vkCreateQueryPool(m_device, &queryInfo, nullptr, &m_queryPool);
+}
+
+void TlasBuilder::deinit()
+{
+  if(m_device == VK_NULL_HANDLE)
+    return;
+  m_alloc->destroy(m_tlas);
+  m_alloc->destroy(m_instances);
+  m_alloc->destroy(m_deltas);
+  m_alloc->destroy(m_scratch);
+  m_instanceCount = 0;
+  m_deltaCapacity = 0;
+  m_scratchSize   = 0;
+
+  vkDestroyPipeline(m_device, m_scatterPipeline, nullptr);
+  vkDestroyPipeline(m_device, m_animatePipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+  vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+  m_cmdPool.deinit();
+  m_device = VK_NULL_HANDLE;
+}
+
+VkPipeline TlasBuilder::createPipeline(const std::string& spvFile, VkPipelineCache pipelineCache)
+{
+  VkComputePipelineCreateInfo createInfo{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  createInfo.layout = m_pipelineLayout;
+  createInfo.stage =
+      nvvk::createShaderStageInfo(m_device, spirv::load(spvFile), VK_SHADER_STAGE_COMPUTE_BIT);
+
+  VkPipeline pipeline{VK_NULL_HANDLE};
+  vkCreateComputePipelines(m_device, pipelineCache, 1, &createInfo, nullptr, &pipeline);
+  vkDestroyShaderModule(m_device, createInfo.stage.module, nullptr);
+  return pipeline;
+}
+
+// 调用者保证之前使用scratch的构建已经完成
+VkDeviceAddress TlasBuilder::getScratch(VkDeviceSize size)
+{
+  if(size > m_scratchSize)
+  {
+    m_alloc->destroy(m_scratch);
+    m_scratch     = m_alloc->createBuffer(size + m_scratchAlignment,
+                                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    m_scratchSize = size;
+  }
+  return alignUp(nvvk::getBufferDeviceAddress(m_device, m_scratch.buffer), m_scratchAlignment);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 录制TLAS的构建或refit，实例数据来自显存中的实例数组
+void TlasBuilder::recordBuild(VkCommandBuffer cmdBuf, bool update)
+{
+  VkAccelerationStructureGeometryInstancesDataKHR instancesData{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR};
+  instancesData.data.deviceAddress = nvvk::getBufferDeviceAddress(m_device, m_instances.buffer);
+
+  VkAccelerationStructureGeometryKHR geometry{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR};
+  geometry.geometryType       = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances = instancesData;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR};
+  buildInfo.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags         = m_flags;
+  buildInfo.mode          = update ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries   = &geometry;
+
+  VkAccelerationStructureBuildSizesInfoKHR sizeInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo,
+                                          &m_instanceCount, &sizeInfo);
+
+  if(!update)
+  {
+    VkAccelerationStructureCreateInfoKHR createInfo{VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR};
+    createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+    createInfo.size = sizeInfo.accelerationStructureSize;
+    m_tlas          = m_alloc->createAcceleration(createInfo);
+  }
+
+  buildInfo.srcAccelerationStructure  = update ? m_tlas.accel : VK_NULL_HANDLE;
+  buildInfo.dstAccelerationStructure  = m_tlas.accel;
+  buildInfo.scratchData.deviceAddress = getScratch(update ? sizeInfo.updateScratchSize : sizeInfo.buildScratchSize);
+
+  VkAccelerationStructureBuildRangeInfoKHR        range{m_instanceCount, 0, 0, 0};
+  const VkAccelerationStructureBuildRangeInfoKHR* pRange = &range;
+  vkCmdBuildAccelerationStructuresKHR(cmdBuf, 1, &buildInfo, &pRange);
+}
+
+//--------------------------------------------------------------------------------------------------
+// 上传全部实例并创建TLAS；实例数改变（增删实例）时调用
+void TlasBuilder::build(const std::vector<VkAccelerationStructureInstanceKHR>& instances, VkBuildAccelerationStructureFlagsKHR flags)
+{
+  // 旧的TLAS和实例数组可能仍被上一帧使用
+  if(m_tlas.accel != VK_NULL_HANDLE)
+  {
+    vkDeviceWaitIdle(m_device);
+    m_alloc->destroy(m_tlas);
+  }
+  m_alloc->destroy(m_instances);
+  m_flags         = flags;
+  m_instanceCount = static_cast<uint32_t>(instances.size());
+
+  VkCommandBuffer cmdBuf = m_cmdPool.createCommandBuffer();
+  vkCmdResetQueryPool(cmdBuf, m_queryPool, 0, 2);
+  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 0);
+
+  // 至少保留一个实例的空间，空场景也能得到有效的buffer地址
+  std::vector<VkAccelerationStructureInstanceKHR> upload = instances;
+  if(upload.empty())
+    upload.push_back(VkAccelerationStructureInstanceKHR{});
+  m_instances = m_alloc->createBuffer(cmdBuf, upload,
+                                      VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                                          | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+
+  // host端的实例变换是动画前的，排队的动画覆盖它们
+  recordAnimation(cmdBuf);
+  recordBuild(cmdBuf, false);
+  submitTimed(cmdBuf);
+  m_alloc->finalizeAndReleaseStaging();
+}
+
+//--------------------------------------------------------------------------------------------------
+// 增量更新：每个变化的实例上传 80 字节，与实例总数无关；排队的动画也在这里执行，只refit一次
+void TlasBuilder::update(const std::vector<VkAccelerationStructureInstanceKHR>& instances, const std::vector<uint32_t>& dirty)
+{
+  if(m_tlas.accel == VK_NULL_HANDLE)
+    return;
+
+  std::vector<uint32_t> indices = dirty;
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+  while(!indices.empty() && indices.back() >= m_instanceCount)
+    indices.pop_back();
+  m_deltaCount = static_cast<uint32_t>(indices.size());
+
+  VkCommandBuffer cmdBuf = m_cmdPool.createCommandBuffer();
+  vkCmdResetQueryPool(cmdBuf, m_queryPool, 0, 2);
+  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool, 0);
+
+  if(m_deltaCount > 0)
+  {
+    VkDeviceSize size = m_deltaCount * sizeof(InstanceDelta);
+    if(size > m_deltaCapacity)
+    {
+      m_alloc->destroy(m_deltas);
+      m_deltaCapacity = std::max<VkDeviceSize>(size, 2 * m_deltaCapacity);
+      m_deltas        = m_alloc->createBuffer(m_deltaCapacity, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    // 上一次 update 已经等待完成，可以直接覆盖
+    auto* mapped = static_cast<InstanceDelta*>(m_alloc->map(m_deltas));
+    for(uint32_t i = 0; i < m_deltaCount; i++)
+    {
+      InstanceDelta delta{};
+      delta.index    = indices[i];
+      delta.instance = instances[indices[i]];
+      memcpy(mapped + i, &delta, sizeof(delta));
+    }
+    m_alloc->unmap(m_deltas);
+
+    PushConstantTlas pc{};
+    pc.instanceAddress = nvvk::getBufferDeviceAddress(m_device, m_instances.buffer);
+    pc.deltaAddress    = nvvk::getBufferDeviceAddress(m_device, m_deltas.buffer);
+    pc.count           = m_deltaCount;
+    recordDispatch(cmdBuf, m_scatterPipeline, pc, m_deltaCount);
+  }
+
+  // 动画在散射之后，同一实例两者都写时以动画为准
+  recordAnimation(cmdBuf);
+  recordBuild(cmdBuf, true);
+  submitTimed(cmdBuf);
+}
+
+void TlasBuilder::animate(uint32_t first, uint32_t count, const glm::mat4& base, float angleOffset, float radius)
+{
+  m_animation             = PushConstantTlas{};
+  m_animation.base        = base;
+  m_animation.first       = first;
+  m_animation.count       = count;
+  m_animation.angleOffset = angleOffset;
+  m_animation.radius      = radius;
+  m_animationPending      = true;
+}
+
+//--------------------------------------------------------------------------------------------------
+// 录制一次写实例数组的计算着色器，之后的barrier保证后续的散射/动画/构建看到写入结果
+void TlasBuilder::recordDispatch(VkCommandBuffer cmdBuf, VkPipeline pipeline, const PushConstantTlas& pc, uint32_t threads)
+{
+  vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdPushConstants(cmdBuf, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstantTlas), &pc);
+  vkCmdDispatch(cmdBuf, (threads + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+
+  VkMemoryBarrier barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+}
+
+void TlasBuilder::recordAnimation(VkCommandBuffer cmdBuf)
+{
+  if(!m_animationPending)
+    return;
+  m_animationPending = false;
+  if(m_animation.first >= m_instanceCount)
+    return;
+
+  PushConstantTlas pc = m_animation;
+  pc.instanceAddress  = nvvk::getBufferDeviceAddress(m_device, m_instances.buffer);
+  pc.count            = std::min(pc.count, m_instanceCount - pc.first);
+  recordDispatch(cmdBuf, m_animatePipeline, pc, pc.count);
+}
+
+// 提交并等待，读取首尾时间戳
+void TlasBuilder::submitTimed(VkCommandBuffer cmdBuf)
+{
+  vkCmdWriteTimestamp(cmdBuf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, 1);
+  m_cmdPool.submitAndWait(cmdBuf);
+
+  uint64_t timestamps[2]{};
+  if(vkGetQueryPoolResults(m_device, m_queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+                           VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)
+     == VK_SUCCESS)
+    m_updateMs = static_cast<float>(timestamps[1] - timestamps[0]) * m_timestampPeriod / 1e6f;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "nvvk/commands_vk.hpp"
+#include "nvvk/resourceallocator_vk.hpp"
+
+#include "shaders/host_device.h"
+
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------
+// TLAS（顶层加速结构）构建器，实例数组常驻显存
+// - build：实例数改变时整体上传一次实例数组并重新创建TLAS
+// - update：只上传变化的实例（索引 + 实例数据），由 tlas_scatter.comp 写入显存中的实例数组，再refit TLAS
+//   nvvk::RaytracingBuilderKHR::buildTlas 每次更新都会经staging重新上传整个数组，10万以上实例时成为瓶颈
+// - animate：由 tlas_animate.comp 在GPU上生成一段实例的变换（程序化动画），不经过host
+//   只记录参数，在下一次 build/update 中与增量散射录制在同一个命令缓冲里，一帧只有一次TLAS构建
+// 两个计算着色器都通过buffer device address访问数据，管线只有push constant，没有描述符集
+//
+class TlasBuilder
+{
+public:
+  void init(VkDevice                 device,
+            VkPhysicalDevice         physicalDevice,
+            uint32_t                 queueFamily,
+            nvvk::ResourceAllocator* alloc,
+            VkPipelineCache          pipelineCache = VK_NULL_HANDLE);
+  void deinit();
+
+  // 用全部实例创建TLAS，替换已有的TLAS；flags 需包含 ALLOW_UPDATE 才能调用 update/animate
+  void build(const std::vector<VkAccelerationStructureInstanceKHR>& instances, VkBuildAccelerationStructureFlagsKHR flags);
+  // 把 dirty 中索引的实例（取自 instances）散射到显存中的实例数组，然后refit TLAS
+  // dirty 可以为空（只有被引用的BLAS原地改变时），可以包含重复索引
+  void update(const std::vector<VkAccelerationStructureInstanceKHR>& instances, const std::vector<uint32_t>& dirty);
+  // 在GPU上把实例 [first, first + count) 均匀排列在绕Y轴的圆上（base * rotateY * translate）
+  // 在下一次 build/update 时执行；只写变换，host端的实例数据不变
+  void animate(uint32_t first, uint32_t count, const glm::mat4& base, float angleOffset, float radius);
+  bool hasPendingAnimation() const { return m_animationPending; }
+
+  VkAccelerationStructureKHR getAccelerationStructure() const { return m_tlas.accel; }
+  uint32_t                   size() const { return m_instanceCount; }
+  // 最近一次 build/update 在GPU上的耗时（散射/生成 + 构建或refit），毫秒
+  float getUpdateTimeMs() const { return m_updateMs; }
+  // 最近一次 update 上传的实例数
+  uint32_t getDeltaCount() const { return m_deltaCount; }
+
+private:
+  VkPipeline      createPipeline(const std::string& spvFile, VkPipelineCache pipelineCache);
+  VkDeviceAddress getScratch(VkDeviceSize size);
+  void            recordBuild(VkCommandBuffer cmdBuf, bool update);
+  void            recordDispatch(VkCommandBuffer cmdBuf, VkPipeline pipeline, const PushConstantTlas& pc, uint32_t threads);
+  void            recordAnimation(VkCommandBuffer cmdBuf);
+  void            submitTimed(VkCommandBuffer cmdBuf);
+
+  VkDevice                 m_device{VK_NULL_HANDLE};
+  nvvk::ResourceAllocator* m_alloc{nullptr};
+  nvvk::CommandPool        m_cmdPool;
+
+  VkPipelineLayout m_pipelineLayout{VK_NULL_HANDLE};
+  VkPipeline       m_scatterPipeline{VK_NULL_HANDLE};
+  VkPipeline       m_animatePipeline{VK_NULL_HANDLE};
+  VkQueryPool      m_queryPool{VK_NULL_HANDLE};
+  float            m_timestampPeriod{1.0f};
+
+  nvvk::AccelKHR                       m_tlas;
+  VkBuildAccelerationStructureFlagsKHR m_flags{0};
+  nvvk::Buffer                         m_instances;  // 显存中的实例数组
+  uint32_t                             m_instanceCount{0};
+  nvvk::Buffer                         m_deltas;  // host可见，按需增长
+  VkDeviceSize                         m_deltaCapacity{0};
+  nvvk::Buffer                         m_scratch;
+  VkDeviceSize                         m_scratchSize{0};
+  VkDeviceSize                         m_scratchAlignment{256};
+
+  PushConstantTlas m_animation{};
+  bool             m_animationPending{false};
+
+  float    m_updateMs{0.0f};
+  uint32_t m_deltaCount{0};
+};